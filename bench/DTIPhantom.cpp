@@ -0,0 +1,185 @@
+#include "DTIPhantom.h"
+#include "SymmetricEigen3.h"
+#include "VolumeFile.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+const float AXIAL_DIFFUSIVITY = 1.7e-3f;     // mm^2/s, white matter along the fiber
+const float RADIAL_DIFFUSIVITY = 0.3e-3f;
+const float ISOTROPIC_DIFFUSIVITY = 0.8e-3f; // grey matter / CSF mix
+const size_t SOLVE_BLOCK = 64;
+
+typedef std::array<float, 6> Tensor;    // xx xy xz yy yz zz, as itk::DiffusionTensor3D
+
+Tensor fiberTensor(float ex, float ey, float ez) {
+    const float delta = AXIAL_DIFFUSIVITY - RADIAL_DIFFUSIVITY;
+    return {RADIAL_DIFFUSIVITY + delta * ex * ex, delta * ex * ey, delta * ex * ez,
+            RADIAL_DIFFUSIVITY + delta * ey * ey, delta * ey * ez,
+            RADIAL_DIFFUSIVITY + delta * ez * ez};
+}
+
+// Attached NRRD: text header, blank line, then raw little-endian data in the same file.
+void writeNrrdHeader(std::ofstream& out, const char* type, int components, const char* kind,
+                     const PhantomOptions& options) {
+    const int* dims = options.dimensions;
+    const double s = options.spacing;
+    out << "NRRD0004\n";
+    out << "type: " << type << "\n";
+    if (components > 1) {
+        out << "dimension: 4\n";
+        out << "space: left-posterior-superior\n";
+        out << "sizes: " << components << " " << dims[0] << " " << dims[1] << " " << dims[2] << "\n";
+        out << "space directions: none (" << s << ",0,0) (0," << s << ",0) (0,0," << s << ")\n";
+        out << "kinds: " << kind << " domain domain domain\n";
+    } else {
+        out << "dimension: 3\n";
+        out << "space: left-posterior-superior\n";
+        out << "sizes: " << dims[0] << " " << dims[1] << " " << dims[2] << "\n";
+        out << "space directions: (" << s << ",0,0) (0," << s << ",0) (0,0," << s << ")\n";
+        out << "kinds: domain domain domain\n";
+    }
+    out << "endian: little\n";
+    out << "encoding: raw\n";
+    out << "space origin: (0,0,0)\n\n";
+}
+
+template <typename T>
+void writeSlice(std::ofstream& out, const std::vector<T>& values, const std::string& path) {
+    out.write(reinterpret_cast<const char*>(values.data()), static_cast<std::streamsize>(values.size() * sizeof(T)));
+    if (!out) {
+        throw std::runtime_error("Failed writing " + path);
+    }
+}
+
+std::ofstream openOutput(const std::string& path) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        throw std::runtime_error("Cannot write " + path);
+    }
+    return out;
+}
+
+}
+
+PhantomFiles writeDTIPhantom(const std::string& directory, const PhantomOptions& options) {
+    const int nx = options.dimensions[0], ny = options.dimensions[1], nz = options.dimensions[2];
+    if (nx < 8 || ny < 8 || nz < 4) {
+        throw std::runtime_error("Phantom needs at least 8 x 8 x 4 voxels");
+    }
+
+    PhantomFiles files;
+    files.tensorPath = directory + "/tensor.nrrd";
+    files.faPath = directory + "/FA.nrrd";
+    files.eigenvectorImagePath = directory + "/eigenvector.nrrd";
+    files.eigenvectorVolumePath = directory + "/eigenvector_data.bin";
+    files.labelPath = directory + "/labels.nrrd";
+
+    std::ofstream tensorOut = openOutput(files.tensorPath);
+    std::ofstream faOut = openOutput(files.faPath);
+    std::ofstream vectorOut = openOutput(files.eigenvectorImagePath);
+    std::ofstream labelOut = openOutput(files.labelPath);
+    writeNrrdHeader(tensorOut, "float", 6, "3D-symmetric-matrix", options);
+    writeNrrdHeader(faOut, "float", 1, "", options);
+    writeNrrdHeader(vectorOut, "float", 3, "vector", options);
+    writeNrrdHeader(labelOut, "uchar", 1, "", options);
+
+    const uint64_t volumeDims[3] = {static_cast<uint64_t>(nx), static_cast<uint64_t>(ny), static_cast<uint64_t>(nz)};
+    VolumeHeader header = makeVolumeHeader(volumeDims, 3, VolumeDataType::Float32, VolumeLayout::XFastest);
+    const double spacing[3] = {options.spacing, options.spacing, options.spacing};
+    const double origin[3] = {0.0, 0.0, 0.0};
+    const double identity[9] = {1, 0, 0, 0, 1, 0, 0, 0, 1};
+    setVoxelToWorld(header, spacing, origin, identity);
+    VolumeFileWriter volumeOut(files.eigenvectorVolumePath, header);
+
+    // geometry, in voxel coordinates of voxel centres
+    const double cx = 0.5 * (nx - 1), cy = 0.5 * (ny - 1), cz = 0.5 * (nz - 1);
+    const double radius = options.bundleRadius > 0.0 ? options.bundleRadius : std::max(1.5, 0.1 * std::min(nx, ny));
+    const double arcRadius = 0.3 * std::min(nx, ny);
+    const double arcZ = std::min(cz + 2.5 * radius, nz - 1.0 - radius);
+    const double maskRadius[3] = {0.48 * nx, 0.48 * ny, 0.48 * nz};
+    const int seedX = std::max(1, nx / 8);
+
+    const size_t sliceVoxels = static_cast<size_t>(nx) * ny;
+    std::vector<float> tensors(sliceVoxels * 6), fa(sliceVoxels), vectors(sliceVoxels * 3);
+    std::vector<unsigned char> labels(sliceVoxels);
+    TensorBlock<float, SOLVE_BLOCK> block;
+    EigenBlock<float, SOLVE_BLOCK> eigen;
+
+    for (int z = 0; z < nz; z++) {
+        for (int y = 0; y < ny; y++) {
+            for (int x = 0; x < nx; x++) {
+                const size_t voxel = static_cast<size_t>(y) * nx + x;
+                Tensor sum = {0, 0, 0, 0, 0, 0};
+                int bundles = 0;
+                auto add = [&](const Tensor& t) {
+                    for (int k = 0; k < 6; k++) sum[k] += t[k];
+                    bundles++;
+                };
+
+                const double mx = (x - cx) / maskRadius[0], my = (y - cy) / maskRadius[1], mz = (z - cz) / maskRadius[2];
+                const bool inBrain = mx * mx + my * my + mz * mz <= 1.0;
+                labels[voxel] = 0;
+                if (inBrain) {
+                    const double toX = std::hypot(y - cy, z - cz);
+                    const double toY = std::hypot(x - cx, z - cz);
+                    if (toX <= radius) {
+                        add(fiberTensor(1.0f, 0.0f, 0.0f));
+                        if (x >= seedX && x < seedX + 2) {
+                            labels[voxel] = 1;
+                        }
+                    }
+                    if (toY <= radius) {
+                        add(fiberTensor(0.0f, 1.0f, 0.0f));
+                    }
+                    const double dx = x - cx, dy = y - cy;
+                    const double r = std::hypot(dx, dy);
+                    if (r > 0.0 && std::hypot(r - arcRadius, z - arcZ) <= radius) {
+                        add(fiberTensor(static_cast<float>(-dy / r), static_cast<float>(dx / r), 0.0f));
+                    }
+                    if (bundles == 0) {
+                        sum = {ISOTROPIC_DIFFUSIVITY, 0, 0, ISOTROPIC_DIFFUSIVITY, 0, ISOTROPIC_DIFFUSIVITY};
+                        bundles = 1;
+                    }
+                }
+                for (int k = 0; k < 6; k++) {
+                    tensors[voxel * 6 + k] = bundles ? sum[k] / bundles : 0.0f;
+                }
+            }
+        }
+
+        // FA and e1 with the same solver as ComputeTensorMaps
+        for (size_t first = 0; first < sliceVoxels; first += SOLVE_BLOCK) {
+            const size_t count = std::min(SOLVE_BLOCK, sliceVoxels - first);
+            for (size_t i = 0; i < count; i++) {
+                const float* t = &tensors[(first + i) * 6];
+                block.xx[i] = t[0];
+                block.xy[i] = t[1];
+                block.xz[i] = t[2];
+                block.yy[i] = t[3];
+                block.yz[i] = t[4];
+                block.zz[i] = t[5];
+            }
+            SolveTensorBlock(block, eigen, count);
+            for (size_t i = 0; i < count; i++) {
+                fa[first + i] = eigen.fa[i];
+                vectors[(first + i) * 3] = eigen.e1x[i];
+                vectors[(first + i) * 3 + 1] = eigen.e1y[i];
+                vectors[(first + i) * 3 + 2] = eigen.e1z[i];
+            }
+        }
+
+        writeSlice(tensorOut, tensors, files.tensorPath);
+        writeSlice(faOut, fa, files.faPath);
+        writeSlice(vectorOut, vectors, files.eigenvectorImagePath);
+        writeSlice(labelOut, labels, files.labelPath);
+        volumeOut.writeVoxels(static_cast<uint64_t>(z) * sliceVoxels, vectors.data(), sliceVoxels);
+    }
+    volumeOut.close();
+    return files;
+}
\ No newline at end of file
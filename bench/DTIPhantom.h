@@ -0,0 +1,31 @@
+#ifndef DTI_PHANTOM_H
+#define DTI_PHANTOM_H
+
+#include <string>
+
+// Synthetic diffusion tensor volume for benchmarks, so nothing depends on ../data.
+// Inside an ellipsoidal brain mask the background is isotropic (FA 0); three
+// tube-shaped bundles carry prolate tensors (FA ~0.8):
+//   a straight bundle along x and one along y that cross at the centre
+//   (tensors are averaged there, so FA drops like a real crossing), and a
+//   circular arc in the xy plane above them.
+// Outside the mask tensors are zero. Everything is deterministic in the options.
+struct PhantomOptions {
+    int dimensions[3] = {96, 96, 60};
+    double spacing = 2.0;           // mm, isotropic
+    double bundleRadius = 0.0;      // voxels; 0 picks a tenth of the smallest in-plane size
+};
+
+struct PhantomFiles {
+    std::string tensorPath;             // 6 x float32 NRRD, 3D-symmetric-matrix, ITK component order
+    std::string faPath;                 // float32 NRRD
+    std::string eigenvectorImagePath;   // 3 x float32 NRRD vector image, for the ITK trackers
+    std::string eigenvectorVolumePath;  // VolumeFile container of e1, for the VTK trackers
+    std::string labelPath;              // uint8 NRRD: 1 on a cross-section of the x bundle
+};
+
+// Writes the phantom into directory (which must exist) one slice at a time,
+// so any size fits in memory.
+PhantomFiles writeDTIPhantom(const std::string& directory, const PhantomOptions& options);
+
+#endif // DTI_PHANTOM_H
\ No newline at end of file
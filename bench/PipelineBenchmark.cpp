@@ -0,0 +1,313 @@
+// Stage-by-stage throughput of the whole pipeline on a synthetic phantom, at
+// several thread counts, written as a JSON baseline that later runs can be
+// diffed against. Each measurement is the median of --repeats runs.
+//
+//   PipelineBenchmark [--dims X Y Z] [--threads 1,2,4,8] [--repeats 3]
+//                     [--workdir bench_data] [--json pipeline_baseline.json]
+//
+// Stages: phantom (generation, single thread), fa, eigen, tensor_maps (ITK,
+// multithreaded), in_memory (InMemorySubject up to the tracking records),
+// voxel_bfs (TractographyLabeled), tracking (continuous streamlines from every
+// voxel with FA >= 0.3), polydata (buildFiberPolyData), tck_write / tck_read
+// (TractogramIO), index_build / roi_query (StreamlineIndex over the tracked
+// fibers) and whole_brain (tracking streamed to disk).
+// Built by the PipelineBenchmark target of the top-level CMakeLists.txt.
+#include "DTIPhantom.h"
+#include "ComputeFAImage.h"
+#include "ComputePrincipalEigenvector.h"
+#include "ComputeTensorMaps.h"
+#include "InMemorySubject.h"
+#include "TractographyLabeled.h"
+#include "VolumeStore.h"
+#include "StreamlineIntegrator.h"
+#include "ParallelSeedTracker.h"
+#include "FiberPolyData.h"
+#include "TractogramIO.h"
+#include "StreamlineIndex.h"
+#include "WholeBrainFiberTrack.h"
+#include <itkMultiThreaderBase.h>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/stat.h>
+
+namespace {
+
+struct StageResult {
+    std::string stage;
+    unsigned int threads;
+    double seconds;
+    double work;            // units of work done per run
+    std::string unit;
+};
+
+double medianSeconds(int repeats, const std::function<void()>& run) {
+    std::vector<double> times;
+    for (int i = 0; i < repeats; i++) {
+        auto start = std::chrono::steady_clock::now();
+        run();
+        auto end = std::chrono::steady_clock::now();
+        times.push_back(std::chrono::duration<double>(end - start).count());
+    }
+    std::sort(times.begin(), times.end());
+    return times[times.size() / 2];
+}
+
+std::vector<unsigned int> parseThreadList(const char* text) {
+    std::vector<unsigned int> threads;
+    std::stringstream list(text);
+    std::string item;
+    while (std::getline(list, item, ',')) {
+        int count = std::atoi(item.c_str());
+        if (count > 0) {
+            threads.push_back(static_cast<unsigned int>(count));
+        }
+    }
+    return threads;
+}
+
+std::vector<unsigned int> defaultThreadList() {
+    const unsigned int hardware = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<unsigned int> threads;
+    for (unsigned int count = 1; count < hardware; count *= 2) {
+        threads.push_back(count);
+    }
+    threads.push_back(hardware);
+    return threads;
+}
+
+void setITKThreads(unsigned int threads) {
+    itk::MultiThreaderBase::SetGlobalMaximumNumberOfThreads(std::max(threads, itk::MultiThreaderBase::GetGlobalMaximumNumberOfThreads()));
+    itk::MultiThreaderBase::SetGlobalDefaultNumberOfThreads(threads);
+}
+
+uint64_t fileBytes(const std::string& path) {
+    struct stat info;
+    return stat(path.c_str(), &info) == 0 ? static_cast<uint64_t>(info.st_size) : 0;
+}
+
+void writeJson(const std::string& path, const PhantomOptions& phantom, int repeats, const std::vector<StageResult>& results) {
+    std::ofstream out(path, std::ios::trunc);
+    if (!out) {
+        throw std::runtime_error("Cannot write " + path);
+    }
+    out << "{\n";
+    out << "  \"benchmark\": \"pipeline\",\n";
+    out << "  \"phantom\": {\"dimensions\": [" << phantom.dimensions[0] << ", " << phantom.dimensions[1] << ", "
+        << phantom.dimensions[2] << "], \"spacing\": " << phantom.spacing << "},\n";
+    out << "  \"hardware_threads\": " << std::thread::hardware_concurrency() << ",\n";
+    out << "  \"repeats\": " << repeats << ",\n";
+    out << "  \"stages\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const StageResult& r = results[i];
+        // speedup against the same stage's single-thread (first) entry
+        double baseline = r.seconds;
+        for (const auto& other : results) {
+            if (other.stage == r.stage) {
+                baseline = other.seconds;
+                break;
+            }
+        }
+        char line[512];
+        std::snprintf(line, sizeof(line),
+                      "    {\"stage\": \"%s\", \"threads\": %u, \"seconds\": %.6f, \"throughput\": %.6g, "
+                      "\"unit\": \"%s\", \"speedup\": %.3f}%s\n",
+                      r.stage.c_str(), r.threads, r.seconds, r.work / r.seconds, r.unit.c_str(),
+                      baseline / r.seconds, i + 1 < results.size() ? "," : "");
+        out << line;
+    }
+    out << "  ]\n";
+    out << "}\n";
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    PhantomOptions phantom;
+    std::vector<unsigned int> threadCounts = defaultThreadList();
+    int repeats = 3;
+    std::string workdir = "bench_data";
+    std::string jsonPath = "pipeline_baseline.json";
+
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--dims") == 0 && i + 3 < argc) {
+            for (int k = 0; k < 3; k++) {
+                phantom.dimensions[k] = std::atoi(argv[++i]);
+            }
+        } else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threadCounts = parseThreadList(argv[++i]);
+        } else if (std::strcmp(argv[i], "--repeats") == 0 && i + 1 < argc) {
+            repeats = std::max(1, std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "--workdir") == 0 && i + 1 < argc) {
+            workdir = argv[++i];
+        } else if (std::strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            jsonPath = argv[++i];
+        } else {
+            std::cerr << "Unknown argument " << argv[i] << std::endl;
+            return 1;
+        }
+    }
+    if (threadCounts.empty()) {
+        threadCounts.push_back(1);
+    }
+    mkdir(workdir.c_str(), 0755);
+
+    const double voxels = static_cast<double>(phantom.dimensions[0]) * phantom.dimensions[1] * phantom.dimensions[2];
+    std::vector<StageResult> results;
+    auto record = [&](const std::string& stage, unsigned int threads, double seconds, double work, const std::string& unit) {
+        results.push_back({stage, threads, seconds, work, unit});
+        printf("%-12s %3u threads  %9.4f s  %12.4g %s\n", stage.c_str(), threads, seconds, work / seconds, unit.c_str());
+    };
+
+    PhantomFiles files;
+    double seconds = medianSeconds(1, [&] { files = writeDTIPhantom(workdir, phantom); });
+    record("phantom", 1, seconds, voxels, "voxels/s");
+
+    // ITK stages
+    const std::string faOut = workdir + "/bench_FA.nrrd";
+    const std::string eigenOut = workdir + "/bench_e1.nrrd";
+    const std::string bfsOut = workdir + "/bench_bfs.nrrd";
+    for (unsigned int threads : threadCounts) {
+        setITKThreads(threads);
+        seconds = medianSeconds(repeats, [&] { ComputeFAImage(files.tensorPath, faOut); });
+        record("fa", threads, seconds, voxels, "voxels/s");
+
+        seconds = medianSeconds(repeats, [&] { ComputePrincipalEigenvector(files.tensorPath, eigenOut); });
+        record("eigen", threads, seconds, voxels, "voxels/s");
+
+        TensorMapOutputs maps;
+        maps.faPath = faOut;
+        maps.eigenvectorPath = eigenOut;
+        seconds = medianSeconds(repeats, [&] { ComputeTensorMaps(files.tensorPath, maps); });
+        record("tensor_maps", threads, seconds, voxels, "voxels/s");
+
+        // tensor -> tracking records with no file in between, vs. tensor_maps plus reopening its outputs
+        seconds = medianSeconds(repeats, [&] {
+            InMemorySubject subject(files.tensorPath, "memory:bench");
+            VolumeStore::openDirectionFAVolume(subject.vectorPath(), subject.faPath());
+        });
+        record("in_memory", threads, seconds, voxels, "voxels/s");
+
+        seconds = medianSeconds(repeats, [&] {
+            PerformTractographyLabeled(files.tensorPath, files.faPath, files.labelPath, files.eigenvectorImagePath, bfsOut);
+        });
+        record("voxel_bfs", threads, seconds, voxels, "voxels/s");
+    }
+
+    // continuous tracking from every voxel centre with FA >= 0.3, both directions
+    auto volume = VolumeStore::openDirectionFAVolume(files.eigenvectorVolumePath, files.faPath);
+    auto mask = VolumeStore::openActiveMask(files.eigenvectorVolumePath, *volume);
+    StreamlineIntegrator integrator(volume->sampler(), mask.get());
+    StreamlineParameters params;
+    params.minFA = 0.3;
+    integrator.setParameters(params);
+
+    std::vector<std::array<double, 3>> seeds;
+    const TrackingSampler sampler = volume->sampler();
+    for (int z = 0; z < volume->dimensions[2]; z++) {
+        for (int y = 0; y < volume->dimensions[1]; y++) {
+            for (int x = 0; x < volume->dimensions[0]; x++) {
+                if (decodeVoxel(sampler.at(x, y, z)).fa >= params.minFA) {
+                    seeds.push_back({x + 0.5, y + 0.5, z + 0.5});
+                }
+            }
+        }
+    }
+
+    Tractogram fibers;
+    auto trace = [&](const std::array<double, 3>& seed, std::vector<std::array<double, 3>>& out) {
+        integrator.trace(seed, out);
+    };
+    for (unsigned int threads : threadCounts) {
+        ParallelSeedTracker tracker(threads);
+        seconds = medianSeconds(repeats, [&] {
+            fibers.clear();
+            tracker.run(seeds, trace, fibers);
+        });
+        record("tracking", threads, seconds, static_cast<double>(fibers.pointCount()), "points/s");
+    }
+
+    // geometry and file I/O are single-threaded today
+    seconds = medianSeconds(repeats, [&] { buildFiberPolyData(fibers); });
+    record("polydata", 1, seconds, static_cast<double>(fibers.pointCount()), "points/s");
+
+    const std::string tckPath = workdir + "/bench_tracks.tck";
+    const TractogramHeader header = makeTractogramHeader(volume->dimensions, volume->voxelToWorld);
+    seconds = medianSeconds(repeats, [&] {
+        TractogramWriter writer(tckPath, header);
+        writer.writeStreamlines(fibers);
+        writer.close();
+    });
+    const double tckBytes = static_cast<double>(fileBytes(tckPath));
+    record("tck_write", 1, seconds, tckBytes / 1e6, "MB/s");
+
+    double checksum = 0.0;
+    seconds = medianSeconds(repeats, [&] {
+        TractogramReader reader(tckPath);
+        for (size_t i = 0; i < reader.size(); i++) {
+            StreamlineSpan span = reader[i];
+            for (size_t p = 0; p < span.pointCount; p++) {
+                checksum += span.point(p)[0];
+            }
+        }
+    });
+    record("tck_read", 1, seconds, tckBytes / 1e6, "MB/s");
+
+    StreamlineIndex index;
+    for (unsigned int threads : threadCounts) {
+        seconds = medianSeconds(repeats, [&] { index = StreamlineIndex::build(fibers, volume->dimensions, threads); });
+        record("index_build", threads, seconds, static_cast<double>(fibers.size()), "streamlines/s");
+    }
+
+    // through a central box, ending in one of two side boxes and missing a third
+    auto box = [&](double fx, double fy, double fz, int size) {
+        std::vector<uint64_t> voxels;
+        const int x0 = static_cast<int>(fx * volume->dimensions[0]);
+        const int y0 = static_cast<int>(fy * volume->dimensions[1]);
+        const int z0 = static_cast<int>(fz * volume->dimensions[2]);
+        for (int z = z0; z < std::min(z0 + size, volume->dimensions[2]); z++) {
+            for (int y = y0; y < std::min(y0 + size, volume->dimensions[1]); y++) {
+                for (int x = x0; x < std::min(x0 + size, volume->dimensions[0]); x++) {
+                    voxels.push_back(x + static_cast<uint64_t>(volume->dimensions[0]) *
+                                             (y + static_cast<uint64_t>(volume->dimensions[1]) * z));
+                }
+            }
+        }
+        return voxels;
+    };
+    RoiQuery query;
+    query.include.push_back(box(0.45, 0.45, 0.45, 8));
+    std::vector<uint64_t> sides = box(0.2, 0.4, 0.4, 16);
+    const std::vector<uint64_t> right = box(0.7, 0.4, 0.4, 16);
+    sides.insert(sides.end(), right.begin(), right.end());
+    query.end.push_back(sides);
+    query.exclude.push_back(box(0.45, 0.2, 0.45, 8));
+    size_t selected = 0;
+    seconds = medianSeconds(repeats, [&] { selected = index.select(query).count(); });
+    record("roi_query", 1, seconds, 1.0, "queries/s");
+    checksum += static_cast<double>(selected);
+
+    const std::string wholeBrainPath = workdir + "/bench_whole_brain.tck";
+    for (unsigned int threads : threadCounts) {
+        WholeBrainFiberTrack wholeBrain(files.eigenvectorVolumePath.c_str(), files.faPath.c_str());
+        wholeBrain.setStreamlineParameters(params);
+        wholeBrain.setSeedsPerVoxel(2);
+        wholeBrain.setNumberOfThreads(threads);
+        seconds = medianSeconds(repeats, [&] { wholeBrain.traceAllFibers(wholeBrainPath); });
+        record("whole_brain", threads, seconds, static_cast<double>(wholeBrain.getStreamlineCount()), "streamlines/s");
+    }
+
+    writeJson(jsonPath, phantom, repeats, results);
+    printf("baseline written to %s (checksum %.3f)\n", jsonPath.c_str(), checksum);
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,248 @@
+// Per-step lookup cost of the tracker hot loop, before and after VoxelSampler.
+//   before: FA through vtkImageData::GetScalarComponentAsDouble plus the direction
+//           from a separate x-major float array (two buffers, two cache lines)
+//   after:  one interleaved 16-byte record per voxel, nearest and trilinear
+// then whole-brain tracking over the linear and the 8^3 bricked record layout, and
+// over bricked octahedral records (6 and 5 bytes) with their worst angular error,
+// with hardware cache and dTLB miss counts where perf events are available.
+// Built by the SamplerBenchmark target of the top-level CMakeLists.txt.
+#include <vtkSmartPointer.h>
+#include <vtkImageData.h>
+#include "VoxelSampler.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+const int DIMS[3] = {144, 144, 85};
+const int NUM_STEPS = 20000000;
+
+// smoothly varying field, so a walk along it stays coherent like a real fiber
+std::array<float, 3> fieldDirection(int x, int y, int z) {
+    float a = 0.05f * x + 0.03f * z;
+    float b = 0.04f * y;
+    return {std::cos(a) * std::cos(b), std::sin(a) * std::cos(b), std::sin(b)};
+}
+
+// random walk along the field, restarting at a random voxel when it leaves the grid
+std::vector<std::array<double, 3>> makeWalk(int count) {
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    std::vector<std::array<double, 3>> walk(count);
+    std::array<double, 3> p = {72, 72, 42};
+    for (int i = 0; i < count; i++) {
+        walk[i] = p;
+        auto d = fieldDirection(static_cast<int>(p[0]), static_cast<int>(p[1]), static_cast<int>(p[2]));
+        for (int k = 0; k < 3; k++) {
+            p[k] += 0.5 * d[k];
+        }
+        if (p[0] < 0 || p[0] >= DIMS[0] - 1 || p[1] < 0 || p[1] >= DIMS[1] - 1 || p[2] < 0 || p[2] >= DIMS[2] - 1) {
+            for (int k = 0; k < 3; k++) {
+                p[k] = uniform(rng) * (DIMS[k] - 1);
+            }
+        }
+    }
+    return walk;
+}
+
+// one hardware counter for the calling thread; reads -1 when perf events are unavailable
+class PerfCounter {
+private:
+    int fd;
+
+public:
+    PerfCounter(uint32_t type, uint64_t config) {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+    ~PerfCounter() {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    void start() {
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+    long long stop() {
+        long long count = -1;
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(fd, &count, sizeof(count)) != sizeof(count)) {
+                count = -1;
+            }
+        }
+        return count;
+    }
+};
+
+// every voxel above the FA threshold seeds one streamline, traced both ways with
+// nearest lookups like the trackers do
+template <typename TLayout, typename TRecord>
+void reportWholeBrain(const char* name, const std::vector<TRecord>& records) {
+    VoxelSampler<TRecord, TLayout> sampler(records.data(), DIMS);
+    PerfCounter cacheMisses(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    PerfCounter tlbMisses(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB |
+                                             (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                             (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+
+    long long steps = 0;
+    double sink = 0.0;
+    auto start = std::chrono::steady_clock::now();
+    cacheMisses.start();
+    tlbMisses.start();
+    for (int z = 0; z < DIMS[2]; z++) {
+        for (int y = 0; y < DIMS[1]; y++) {
+            for (int x = 0; x < DIMS[0]; x++) {
+                if (decodeVoxel(sampler.at(x, y, z)).fa < 0.3f) {
+                    continue;
+                }
+                for (int direction : {-1, 1}) {
+                    std::array<double, 3> p = {x + 0.5, y + 0.5, z + 0.5};
+                    DirectionFAVoxel v = sampler.nearest(p);
+                    for (int i = 0; i < 200 && v.fa >= 0.3f; i++, steps++) {
+                        for (int k = 0; k < 3; k++) {
+                            p[k] += 0.5 * direction * v.direction[k];
+                        }
+                        if (!sampler.isInside(p)) {
+                            break;
+                        }
+                        v = sampler.nearest(p);
+                        sink += v.fa;
+                    }
+                }
+            }
+        }
+    }
+    long long tlb = tlbMisses.stop();
+    long long misses = cacheMisses.stop();
+    auto end = std::chrono::steady_clock::now();
+    double ns = std::chrono::duration<double, std::nano>(end - start).count() / steps;
+    printf("%-28s %7.2f ns/step  %lld steps  cache misses %lld  dTLB misses %lld  (checksum %.3f)\n",
+           name, ns, steps, misses, tlb, sink);
+}
+
+// same records re-encoded as TRecord, and the largest angle between an original and a decoded direction
+template <typename TRecord>
+std::vector<TRecord> encodeRecords(const std::vector<DirectionFAVoxel>& records, double& maxAngleDegrees) {
+    std::vector<TRecord> encoded(records.size());
+    maxAngleDegrees = 0.0;
+    for (size_t i = 0; i < records.size(); i++) {
+        encodeVoxel(records[i], encoded[i]);
+        DirectionFAVoxel decoded = decodeVoxel(encoded[i]);
+        const float* a = records[i].direction;
+        const float* b = decoded.direction;
+        if (a[0] == 0.0f && a[1] == 0.0f && a[2] == 0.0f) {
+            continue;   // brick padding
+        }
+        double cross[3] = {double(a[1]) * b[2] - double(a[2]) * b[1], double(a[2]) * b[0] - double(a[0]) * b[2],
+                           double(a[0]) * b[1] - double(a[1]) * b[0]};
+        double dot = double(a[0]) * b[0] + double(a[1]) * b[1] + double(a[2]) * b[2];
+        double angle = std::atan2(std::sqrt(cross[0] * cross[0] + cross[1] * cross[1] + cross[2] * cross[2]), dot);
+        maxAngleDegrees = std::max(maxAngleDegrees, angle * 180.0 / M_PI);
+    }
+    return encoded;
+}
+
+template <typename Step>
+void report(const char* name, const std::vector<std::array<double, 3>>& walk, Step step) {
+    double sink = 0.0;
+    auto start = std::chrono::steady_clock::now();
+    for (const auto& point : walk) {
+        sink += step(point);
+    }
+    auto end = std::chrono::steady_clock::now();
+    double ns = std::chrono::duration<double, std::nano>(end - start).count() / walk.size();
+    printf("%-28s %7.2f ns/step  (checksum %.3f)\n", name, ns, sink);
+}
+
+}
+
+int main() {
+    const size_t voxelCount = static_cast<size_t>(DIMS[0]) * DIMS[1] * DIMS[2];
+
+    // before: FA image plus legacy x-major direction buffer
+    auto faImage = vtkSmartPointer<vtkImageData>::New();
+    faImage->SetDimensions(DIMS[0], DIMS[1], DIMS[2]);
+    faImage->AllocateScalars(VTK_FLOAT, 1);
+    float* fa = static_cast<float*>(faImage->GetScalarPointer());
+    std::vector<float> vectors(voxelCount * 3);
+
+    // after: interleaved records, linear and bricked
+    std::vector<DirectionFAVoxel> records(voxelCount);
+    std::vector<DirectionFAVoxel> bricked(BrickedLayout<8>::recordCount(DIMS), DirectionFAVoxel{{0.0f, 0.0f, 0.0f}, 0.0f});
+    BrickedLayout<8> brickedLayout(DIMS);
+
+    size_t voxel = 0;
+    for (int z = 0; z < DIMS[2]; z++) {
+        for (int y = 0; y < DIMS[1]; y++) {
+            for (int x = 0; x < DIMS[0]; x++, voxel++) {
+                auto d = fieldDirection(x, y, z);
+                float value = 0.2f + 0.6f * std::fabs(d[2]);
+                fa[voxel] = value;
+                size_t legacy = ((static_cast<size_t>(x) * DIMS[1] + y) * DIMS[2] + z) * 3;
+                for (int k = 0; k < 3; k++) {
+                    vectors[legacy + k] = d[k];
+                    records[voxel].direction[k] = d[k];
+                }
+                records[voxel].fa = value;
+                bricked[brickedLayout.index(x, y, z)] = records[voxel];
+            }
+        }
+    }
+
+    auto walk = makeWalk(NUM_STEPS);
+    VoxelSampler<DirectionFAVoxel> sampler(records.data(), DIMS);
+
+    report("vtkImageData + x-major", walk, [&](const std::array<double, 3>& p) {
+        int x = static_cast<int>(p[0]), y = static_cast<int>(p[1]), z = static_cast<int>(p[2]);
+        double value = faImage->GetScalarComponentAsDouble(x, y, z, 0);
+        size_t base = ((static_cast<size_t>(x) * DIMS[1] + y) * DIMS[2] + z) * 3;
+        return value + vectors[base] + vectors[base + 1] + vectors[base + 2];
+    });
+
+    report("VoxelSampler::nearest", walk, [&](const std::array<double, 3>& p) {
+        DirectionFAVoxel v = sampler.nearest(p);
+        return static_cast<double>(v.fa + v.direction[0] + v.direction[1] + v.direction[2]);
+    });
+
+    report("VoxelSampler::trilinear", walk, [&](const std::array<double, 3>& p) {
+        DirectionFAVoxel v = sampler.trilinear(p);
+        return static_cast<double>(v.fa + v.direction[0] + v.direction[1] + v.direction[2]);
+    });
+
+    reportWholeBrain<LinearLayout>("whole brain, linear", records);
+    reportWholeBrain<BrickedLayout<8>>("whole brain, bricked 8^3", bricked);
+
+    double maxAngle16 = 0.0;
+    double maxAngle8 = 0.0;
+    auto octahedral16 = encodeRecords<OctahedralVoxel16>(bricked, maxAngle16);
+    auto octahedral8 = encodeRecords<OctahedralVoxel8>(bricked, maxAngle8);
+    reportWholeBrain<BrickedLayout<8>>("whole brain, octahedral16", octahedral16);
+    reportWholeBrain<BrickedLayout<8>>("whole brain, octahedral8", octahedral8);
+    printf("octahedral16: %zu bytes/voxel, max angular error %.5f deg\n", sizeof(OctahedralVoxel16), maxAngle16);
+    printf("octahedral8:  %zu bytes/voxel, max angular error %.5f deg\n", sizeof(OctahedralVoxel8), maxAngle8);
+
+    return 0;
+}
\ No newline at end of file
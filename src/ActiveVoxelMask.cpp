@@ -0,0 +1,138 @@
+#include "ActiveVoxelMask.h"
+#include <bitset>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+
+const char MASK_MAGIC[8] = {'D', 'T', 'I', 'M', 'A', 'S', 'K', '\0'};
+
+struct MaskFileHeader {
+    char magic[8];
+    uint64_t dimensions[3];
+    uint64_t activeCount;
+    uint64_t runCount;
+};
+
+}
+
+ActiveVoxelMask::ActiveVoxelMask() : dims{0, 0, 0}, numActive(0) {
+}
+
+ActiveVoxelMask::ActiveVoxelMask(const uint64_t dimensions[3])
+    : dims{dimensions[0], dimensions[1], dimensions[2]}, numActive(0) {
+    bits.assign((voxelCount() + 63) / 64, 0);
+}
+
+void ActiveVoxelMask::markActive(uint64_t voxel) {
+    uint64_t& word = bits[voxel >> 6];
+    const uint64_t bit = uint64_t(1) << (voxel & 63);
+    if (word & bit) {
+        return;
+    }
+    word |= bit;
+    numActive++;
+
+    // extend the last run when contiguous, otherwise start a new one
+    if (!activeRuns.empty() && activeRuns.back().start + activeRuns.back().length == voxel) {
+        activeRuns.back().length++;
+    } else {
+        activeRuns.push_back({voxel, 1});
+    }
+}
+
+bool ActiveVoxelMask::matches(const uint64_t dimensions[3]) const {
+    return dims[0] == dimensions[0] && dims[1] == dimensions[1] && dims[2] == dimensions[2];
+}
+
+void ActiveVoxelMask::save(const std::string& path) const {
+    std::ofstream out(path, std::ios::binary);
+    if (!out) {
+        throw std::runtime_error("Cannot write " + path);
+    }
+
+    MaskFileHeader header;
+    std::memcpy(header.magic, MASK_MAGIC, sizeof(header.magic));
+    for (int i = 0; i < 3; i++) {
+        header.dimensions[i] = dims[i];
+    }
+    header.activeCount = numActive;
+    header.runCount = activeRuns.size();
+
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(bits.data()), bits.size() * sizeof(uint64_t));
+    out.write(reinterpret_cast<const char*>(activeRuns.data()), activeRuns.size() * sizeof(Run));
+    if (!out) {
+        throw std::runtime_error("Failed writing " + path);
+    }
+}
+
+ActiveVoxelMask ActiveVoxelMask::load(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        throw std::runtime_error("Cannot open " + path);
+    }
+
+    MaskFileHeader header;
+    in.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!in || std::memcmp(header.magic, MASK_MAGIC, sizeof(header.magic)) != 0) {
+        throw std::runtime_error("Not an active voxel mask: " + path);
+    }
+
+    // Consumers walk the runs straight into voxel buffers, so nothing in the
+    // file is trusted: sizes are checked against the file before allocating,
+    // runs must be sorted, disjoint and inside the volume, and the runs, the
+    // bitset and activeCount must all describe the same voxels.
+    const uint64_t maxValue = std::numeric_limits<uint64_t>::max();
+    uint64_t voxelCount = 1;
+    for (int i = 0; i < 3; i++) {
+        if (header.dimensions[i] != 0 && voxelCount > maxValue / header.dimensions[i]) {
+            throw std::runtime_error("Corrupt active voxel mask (dimensions): " + path);
+        }
+        voxelCount *= header.dimensions[i];
+    }
+    const uint64_t wordCount = voxelCount / 64 + (voxelCount % 64 != 0);
+    in.seekg(0, std::ios::end);
+    const uint64_t payloadBytes = static_cast<uint64_t>(in.tellg()) - sizeof(header);
+    in.seekg(sizeof(header), std::ios::beg);
+    if (!in || wordCount > payloadBytes / sizeof(uint64_t) ||
+        header.runCount != (payloadBytes - wordCount * sizeof(uint64_t)) / sizeof(Run) ||
+        (payloadBytes - wordCount * sizeof(uint64_t)) % sizeof(Run) != 0) {
+        throw std::runtime_error("Truncated active voxel mask: " + path);
+    }
+
+    ActiveVoxelMask mask(header.dimensions);
+    mask.numActive = header.activeCount;
+    mask.activeRuns.resize(header.runCount);
+    in.read(reinterpret_cast<char*>(mask.bits.data()), mask.bits.size() * sizeof(uint64_t));
+    in.read(reinterpret_cast<char*>(mask.activeRuns.data()), mask.activeRuns.size() * sizeof(Run));
+    if (!in) {
+        throw std::runtime_error("Truncated active voxel mask: " + path);
+    }
+
+    uint64_t runVoxels = 0;
+    uint64_t runEnd = 0;
+    for (const Run& run : mask.activeRuns) {
+        if (run.length == 0 || run.start < runEnd || run.start >= voxelCount || run.length > voxelCount - run.start) {
+            throw std::runtime_error("Corrupt active voxel mask (runs): " + path);
+        }
+        for (uint64_t voxel = run.start; voxel < run.start + run.length; voxel++) {
+            if (!mask.test(voxel)) {
+                throw std::runtime_error("Corrupt active voxel mask (runs do not match bits): " + path);
+            }
+        }
+        runEnd = run.start + run.length;
+        runVoxels += run.length;
+    }
+    // every run voxel is set, so equal counts leave no other bit set
+    uint64_t setBits = 0;
+    for (uint64_t word : mask.bits) {
+        setBits += std::bitset<64>(word).count();
+    }
+    if (runVoxels != header.activeCount || setBits != header.activeCount) {
+        throw std::runtime_error("Corrupt active voxel mask (active count): " + path);
+    }
+    return mask;
+}
\ No newline at end of file
@@ -0,0 +1,66 @@
+#ifndef ACTIVE_VOXEL_MASK_H
+#define ACTIVE_VOXEL_MASK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Compact set of the voxels worth processing (brain / white matter).
+// Stored twice: a bitset for O(1) membership tests inside the trackers, and a
+// sorted list of runs for stages that only want to iterate active voxels.
+// Voxels are numbered x-fastest, like ITK and vtkImageData buffers.
+class ActiveVoxelMask {
+public:
+    struct Run {
+        uint64_t start;
+        uint64_t length;
+    };
+
+    ActiveVoxelMask();
+    explicit ActiveVoxelMask(const uint64_t dimensions[3]);
+
+    // Marks values[i] > minValue active for voxels firstVoxel .. firstVoxel + count.
+    // Calls must come in increasing voxel order (e.g. one slab after another).
+    template <typename T>
+    void appendValues(uint64_t firstVoxel, const T* values, uint64_t count, T minValue);
+
+    bool test(uint64_t voxel) const {
+        return (bits[voxel >> 6] >> (voxel & 63)) & 1u;
+    }
+    bool test(int x, int y, int z) const {
+        return test(index(x, y, z));
+    }
+    uint64_t index(int x, int y, int z) const {
+        return static_cast<uint64_t>(x) + dims[0] * (static_cast<uint64_t>(y) + dims[1] * static_cast<uint64_t>(z));
+    }
+
+    const std::vector<Run>& runs() const { return activeRuns; }
+    const uint64_t* dimensions() const { return dims; }
+    uint64_t voxelCount() const { return dims[0] * dims[1] * dims[2]; }
+    uint64_t activeCount() const { return numActive; }
+    bool matches(const uint64_t dimensions[3]) const;
+
+    // load throws for a truncated file, or one whose runs, bits and counts disagree
+    void save(const std::string& path) const;
+    static ActiveVoxelMask load(const std::string& path);
+
+private:
+    uint64_t dims[3];
+    uint64_t numActive;
+    std::vector<uint64_t> bits;
+    std::vector<Run> activeRuns;
+
+    void markActive(uint64_t voxel);
+};
+
+template <typename T>
+void ActiveVoxelMask::appendValues(uint64_t firstVoxel, const T* values, uint64_t count, T minValue) {
+    for (uint64_t i = 0; i < count; i++) {
+        if (values[i] > minValue) {
+            markActive(firstVoxel + i);
+        }
+    }
+}
+
+#endif // ACTIVE_VOXEL_MASK_H
\ No newline at end of file
@@ -0,0 +1,78 @@
+#include "AsyncSeedTracker.h"
+#include <algorithm>
+
+AsyncSeedTracker::AsyncSeedTracker(TraceFunction trace)
+    : traceSeed(trace), pendingSeed(nullptr), results(nullptr), dropped(0), stopping(false) {
+    worker = std::thread(&AsyncSeedTracker::run, this);
+}
+
+AsyncSeedTracker::~AsyncSeedTracker() {
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        stopping.store(true);
+    }
+    wake.notify_one();
+    worker.join();
+
+    delete pendingSeed.exchange(nullptr);
+    ResultNode* node = results.exchange(nullptr);
+    while (node) {
+        ResultNode* next = node->next;
+        delete node;
+        node = next;
+    }
+}
+
+void AsyncSeedTracker::submit(const std::array<double, 3>& seed) {
+    std::array<double, 3>* stale = pendingSeed.exchange(new std::array<double, 3>(seed), std::memory_order_acq_rel);
+    if (stale) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        delete stale;
+    }
+
+    // empty critical section: orders the publish against the worker's wait predicate
+    { std::lock_guard<std::mutex> lock(wakeMutex); }
+    wake.notify_one();
+}
+
+std::vector<TracedSeed> AsyncSeedTracker::takeResults() {
+    std::vector<TracedSeed> finished;
+    ResultNode* node = results.exchange(nullptr, std::memory_order_acquire);
+    while (node) {
+        finished.push_back(std::move(node->result));
+        ResultNode* next = node->next;
+        delete node;
+        node = next;
+    }
+    // the list is newest first
+    std::reverse(finished.begin(), finished.end());
+    return finished;
+}
+
+void AsyncSeedTracker::run() {
+    while (true) {
+        std::array<double, 3>* seed = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(wakeMutex);
+            wake.wait(lock, [this] {
+                return stopping.load() || pendingSeed.load(std::memory_order_acquire) != nullptr;
+            });
+            if (stopping.load()) {
+                return;
+            }
+        }
+        seed = pendingSeed.exchange(nullptr, std::memory_order_acq_rel);
+        if (!seed) {
+            continue;
+        }
+
+        ResultNode* node = new ResultNode;
+        node->result.seed = *seed;
+        delete seed;
+        traceSeed(node->result.seed, node->result.points);
+
+        node->next = results.load(std::memory_order_relaxed);
+        while (!results.compare_exchange_weak(node->next, node, std::memory_order_release, std::memory_order_relaxed)) {
+        }
+    }
+}
\ No newline at end of file
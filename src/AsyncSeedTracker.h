@@ -0,0 +1,59 @@
+#ifndef ASYNC_SEED_TRACKER_H
+#define ASYNC_SEED_TRACKER_H
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// One traced seed, handed back to the UI thread.
+struct TracedSeed {
+    std::array<double, 3> seed;
+    std::vector<std::array<double, 3>> points;
+};
+
+// Background worker for interactive seeding.
+// submit() publishes the newest seed in a single lock-free slot: a seed that
+// was not started before the next one arrives is dropped, so the worker always
+// moves on to the most recent click. Finished fibers are pushed onto a
+// lock-free list that the UI thread drains (e.g. from a VTK timer) with takeResults().
+class AsyncSeedTracker {
+public:
+    typedef std::function<void(const std::array<double, 3>&, std::vector<std::array<double, 3>>&)> TraceFunction;
+
+    explicit AsyncSeedTracker(TraceFunction trace);
+    ~AsyncSeedTracker();
+    AsyncSeedTracker(const AsyncSeedTracker&) = delete;
+    AsyncSeedTracker& operator=(const AsyncSeedTracker&) = delete;
+
+    // Never blocks on tracing; safe to call from the interactor.
+    void submit(const std::array<double, 3>& seed);
+    // Fibers finished since the last call, oldest first.
+    std::vector<TracedSeed> takeResults();
+    // Seeds replaced before the worker reached them.
+    unsigned long droppedSeeds() const { return dropped.load(std::memory_order_relaxed); }
+
+private:
+    struct ResultNode {
+        TracedSeed result;
+        ResultNode* next;
+    };
+
+    TraceFunction traceSeed;
+    std::atomic<std::array<double, 3>*> pendingSeed;
+    std::atomic<ResultNode*> results;
+    std::atomic<unsigned long> dropped;
+    std::atomic<bool> stopping;
+
+    // only used to sleep while idle; the hand-off itself never takes it
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+    std::thread worker;
+
+    void run();
+};
+
+#endif // ASYNC_SEED_TRACKER_H
\ No newline at end of file
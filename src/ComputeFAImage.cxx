@@ -1,4 +1,5 @@
 #include "ComputeFAImage.h"
+#include "RunMetrics.h"
 #include "itkImage.h"
 #include "itkImageFileReader.h"
 #include "itkImageFileWriter.h"
@@ -15,6 +16,7 @@ using FAImageType = itk::Image<PixelType, 3>;
 void ComputeFAImage(const std::string &tensorImagePath, const std::string &faOutputPath)
 {
     std::cout << "Task started: Computing FA image" << std::endl;
+    StageTimer timer("fa");
 
     // read DTI
     auto reader = itk::ImageFileReader<TensorImageType>::New();
@@ -31,6 +33,7 @@ void ComputeFAImage(const std::string &tensorImagePath, const std::string &faOut
     faWriter->SetFileName(faOutputPath);
     faWriter->SetInput(faFilter->GetOutput());
     faWriter->Update();
+    RunMetrics::add(MetricCounter::VoxelsProcessed, reader->GetOutput()->GetLargestPossibleRegion().GetNumberOfPixels());
 
     std::cout << "Task completed: FA image saved to " << faOutputPath << std::endl;
 }
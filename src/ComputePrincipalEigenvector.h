@@ -1,8 +1,11 @@
 #ifndef COMPUTE_PRINCIPAL_EIGENVECTOR_H
 #define COMPUTE_PRINCIPAL_EIGENVECTOR_H
 
+#include <cstddef>
 #include <string>
 
-void ComputePrincipalEigenvector(const std::string &tensorImagePath, const std::string &outputImagePath);
+// If vectorVolumePath is set, e1 is also written as a float32 VolumeFile container for the trackers.
+// A non-zero memoryBudgetBytes streams the tensor volume in slabs (see ComputeTensorMaps).
+void ComputePrincipalEigenvector(const std::string &tensorImagePath, const std::string &outputImagePath, const std::string &vectorVolumePath = "", size_t memoryBudgetBytes = 0);
 
 #endif
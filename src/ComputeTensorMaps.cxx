@@ -0,0 +1,420 @@
+#include "ComputeTensorMaps.h"
+#include "SymmetricEigen3.h"
+#include "VolumeFile.h"
+#include "ActiveVoxelMask.h"
+#include "RunMetrics.h"
+#include <itkImageFileReader.h>
+#include <itkImageFileWriter.h>
+#include <itkDiffusionTensor3D.h>
+#include <itkVector.h>
+#include <itkImage.h>
+#include <itkMultiThreaderBase.h>
+#include <itkImageRegionSplitterSlowDimension.h>
+#include <itkImageIORegion.h>
+#include <itkImageIOFactory.h>
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+
+// Precision of the tensor read and the eigen solve, fixed at build time: double, as the
+// tensors have always been read, unless built with -DTENSOR_SOLVE_FLOAT, which halves
+// the tensor memory per slab (e1 stays within 0.05 degrees, see SymmetricEigen3.h).
+#ifdef TENSOR_SOLVE_FLOAT
+using SolveType = float;
+#else
+using SolveType = double;
+#endif
+using RealType = float;
+using TensorPixelType = itk::DiffusionTensor3D<SolveType>;
+using TensorImageType = itk::Image<TensorPixelType, 3>;
+using ScalarImageType = itk::Image<RealType, 3>;
+using VectorType = itk::Vector<RealType, 3>;
+using VectorImageType = itk::Image<VectorType, 3>;
+// the e1 map file keeps the pixel type ComputePrincipalEigenvector has always written
+using EigenvectorType = itk::Vector<double, 3>;
+using EigenvectorImageType = itk::Image<EigenvectorType, 3>;
+using RegionType = TensorImageType::RegionType;
+
+namespace
+{
+const size_t BlockSize = 64;
+
+// tensor files are usually double on disk, so a float solve also pays for the reader's conversion buffer
+const size_t TensorBytesPerVoxel =
+    sizeof(TensorPixelType) + (sizeof(SolveType) == sizeof(double) ? 0 : sizeof(itk::DiffusionTensor3D<double>));
+
+// output image covering one slab of the full volume
+struct MapBuffers {
+    RealType *fa;
+    RealType *md;
+    VectorType *eigenvalues;
+    EigenvectorType *eigenvector;
+    VectorType *trackerEigenvector; // float32 e1, as the trackers read it
+};
+
+template <typename TImage>
+typename TImage::Pointer AllocateSlab(const TensorImageType *reference, const RegionType &slab, bool needed, bool zeroFill)
+{
+    if (!needed) {
+        return nullptr;
+    }
+    auto image = TImage::New();
+    image->SetLargestPossibleRegion(reference->GetLargestPossibleRegion());
+    image->SetBufferedRegion(slab);
+    image->SetRequestedRegion(slab);
+    image->SetSpacing(reference->GetSpacing());
+    image->SetOrigin(reference->GetOrigin());
+    image->SetDirection(reference->GetDirection());
+    image->Allocate(zeroFill);
+    return image;
+}
+
+// Whether a slab can be pasted into path's file (uncompressed .mha/.mhd can, NRRD cannot).
+bool CanStreamWrite(const std::string &path)
+{
+    itk::ImageIOBase::Pointer io = itk::ImageIOFactory::CreateImageIO(path.c_str(), itk::ImageIOFactory::IOFileModeEnum::WriteMode);
+    if (!io) {
+        throw std::runtime_error("No image format can write " + path);
+    }
+    return io->CanStreamWrite();
+}
+
+// first pixel of slab in image, which buffers either that slab or the whole volume
+template <typename TImage>
+typename TImage::PixelType *SlabBuffer(TImage *image, const RegionType &slab)
+{
+    return image ? image->GetBufferPointer() + image->ComputeOffset(slab.GetIndex()) : nullptr;
+}
+
+// writes a whole image, or pastes one slab into the file when streaming
+template <typename TImage>
+void WriteSlab(const TImage *image, const std::string &path, const RegionType &slab, bool streaming)
+{
+    if (path.empty()) {
+        return;
+    }
+    auto writer = itk::ImageFileWriter<TImage>::New();
+    writer->SetFileName(path);
+    writer->SetInput(image);
+    if (streaming) {
+        itk::ImageIORegion ioRegion(3);
+        itk::ImageIORegionAdaptor<3>::Convert(slab, ioRegion, image->GetLargestPossibleRegion().GetIndex());
+        writer->SetIORegion(ioRegion);
+    }
+    writer->Update();
+}
+
+// FA, MD, eigenvalues and e1 for count consecutive voxels; results go to maps at outputFirst
+void SolveSpan(const TensorPixelType *tensors, size_t count, const MapBuffers &maps, size_t outputFirst)
+{
+    TensorBlock<SolveType, BlockSize> in;
+    EigenBlock<SolveType, BlockSize> out;
+
+    for (size_t x0 = 0; x0 < count; x0 += BlockSize) {
+        const size_t blockCount = std::min(BlockSize, count - x0);
+        const TensorPixelType *block = tensors + x0;
+        for (size_t i = 0; i < blockCount; ++i) {
+            in.xx[i] = block[i][0];
+            in.xy[i] = block[i][1];
+            in.xz[i] = block[i][2];
+            in.yy[i] = block[i][3];
+            in.yz[i] = block[i][4];
+            in.zz[i] = block[i][5];
+        }
+
+        SolveTensorBlock(in, out, blockCount);
+
+        const size_t first = outputFirst + x0;
+        if (maps.fa) {
+            std::copy(out.fa, out.fa + blockCount, maps.fa + first);
+        }
+        if (maps.md) {
+            std::copy(out.md, out.md + blockCount, maps.md + first);
+        }
+        for (size_t i = 0; i < blockCount; ++i) {
+            if (maps.eigenvalues) {
+                maps.eigenvalues[first + i][0] = out.l1[i];
+                maps.eigenvalues[first + i][1] = out.l2[i];
+                maps.eigenvalues[first + i][2] = out.l3[i];
+            }
+            if (maps.eigenvector) {
+                maps.eigenvector[first + i][0] = out.e1x[i];
+                maps.eigenvector[first + i][1] = out.e1y[i];
+                maps.eigenvector[first + i][2] = out.e1z[i];
+            }
+            if (maps.trackerEigenvector) {
+                maps.trackerEigenvector[first + i][0] = out.e1x[i];
+                maps.trackerEigenvector[first + i][1] = out.e1y[i];
+                maps.trackerEigenvector[first + i][2] = out.e1z[i];
+            }
+        }
+    }
+}
+
+// every voxel of slab, split across threads by sub-region
+void SolveSlab(const TensorImageType *tensorImage, const RegionType &slab, const MapBuffers &maps)
+{
+    const TensorPixelType *tensorBuffer = tensorImage->GetBufferPointer();
+    const size_t slabX = slab.GetSize(0);
+    const size_t slabY = slab.GetSize(1);
+
+    auto threader = itk::MultiThreaderBase::New();
+    threader->ParallelizeImageRegion<3>(
+        slab,
+        [&](const RegionType &chunk) {
+            TensorImageType::IndexType rowIndex = chunk.GetIndex();
+            for (itk::SizeValueType z = 0; z < chunk.GetSize(2); ++z) {
+                for (itk::SizeValueType y = 0; y < chunk.GetSize(1); ++y) {
+                    rowIndex[1] = chunk.GetIndex(1) + y;
+                    rowIndex[2] = chunk.GetIndex(2) + z;
+                    // the tensor buffer may be larger than the slab if the reader could not stream
+                    const size_t tensorRow = tensorImage->ComputeOffset(rowIndex);
+                    const size_t outputRow = (rowIndex[0] - slab.GetIndex(0)) +
+                        slabX * ((rowIndex[1] - slab.GetIndex(1)) + slabY * (rowIndex[2] - slab.GetIndex(2)));
+                    SolveSpan(tensorBuffer + tensorRow, chunk.GetSize(0), maps, outputRow);
+                }
+            }
+        },
+        nullptr);
+}
+
+// only the active runs of mask that fall inside slab; slabs and buffers always span whole xy-slices
+void SolveSlabMasked(const TensorImageType *tensorImage, const RegionType &slab, const ActiveVoxelMask &mask,
+                     const RegionType &region, const MapBuffers &maps)
+{
+    const uint64_t sliceVoxels = static_cast<uint64_t>(region.GetSize(0)) * region.GetSize(1);
+    const uint64_t slabFirst = (slab.GetIndex(2) - region.GetIndex(2)) * sliceVoxels;
+    const uint64_t slabEnd = slabFirst + slab.GetNumberOfPixels();
+    const uint64_t bufferFirst = (tensorImage->GetBufferedRegion().GetIndex(2) - region.GetIndex(2)) * sliceVoxels;
+    const TensorPixelType *tensorBuffer = tensorImage->GetBufferPointer();
+
+    const std::vector<ActiveVoxelMask::Run> &runs = mask.runs();
+    auto firstRun = std::lower_bound(runs.begin(), runs.end(), slabFirst,
+        [](const ActiveVoxelMask::Run &run, uint64_t voxel) { return run.start + run.length <= voxel; });
+    auto lastRun = std::lower_bound(firstRun, runs.end(), slabEnd,
+        [](const ActiveVoxelMask::Run &run, uint64_t voxel) { return run.start < voxel; });
+    const size_t runOffset = firstRun - runs.begin();
+
+    auto threader = itk::MultiThreaderBase::New();
+    threader->ParallelizeArray(
+        0, lastRun - firstRun,
+        [&](itk::SizeValueType r) {
+            const ActiveVoxelMask::Run &run = runs[runOffset + r];
+            const uint64_t begin = std::max(run.start, slabFirst);
+            const uint64_t end = std::min(run.start + run.length, slabEnd);
+            SolveSpan(tensorBuffer + (begin - bufferFirst), end - begin, maps, begin - slabFirst);
+        },
+        nullptr);
+}
+
+VolumeHeader MakeEigenvectorHeader(const TensorImageType *tensorImage)
+{
+    const RegionType &region = tensorImage->GetLargestPossibleRegion();
+    uint64_t dimensions[3];
+    double spacing[3];
+    double origin[3];
+    double direction[9];
+    for (unsigned int i = 0; i < 3; ++i) {
+        dimensions[i] = region.GetSize(i);
+        spacing[i] = tensorImage->GetSpacing()[i];
+        origin[i] = tensorImage->GetOrigin()[i];
+        for (unsigned int j = 0; j < 3; ++j) {
+            direction[i * 3 + j] = tensorImage->GetDirection()[i][j];
+        }
+    }
+    VolumeHeader header = makeVolumeHeader(dimensions, 3, VolumeDataType::Float32, VolumeLayout::XFastest);
+    setVoxelToWorld(header, spacing, origin, direction);
+    return header;
+}
+}
+
+void ComputeTensorMaps(const std::string &tensorImagePath, const TensorMapOutputs &outputs, size_t memoryBudgetBytes, const std::string &maskPath)
+{
+    std::cout << "Task started: Computing tensor maps" << std::endl;
+    StageTimer timer("tensor_maps");
+
+    // read the header only; pixels are pulled slab by slab
+    auto reader = itk::ImageFileReader<TensorImageType>::New();
+    reader->SetFileName(tensorImagePath);
+    reader->UpdateOutputInformation();
+
+    TensorImageType::Pointer tensorImage = reader->GetOutput();
+    const RegionType region = tensorImage->GetLargestPossibleRegion();
+
+    const uint64_t dims[3] = {region.GetSize(0), region.GetSize(1), region.GetSize(2)};
+    std::unique_ptr<ActiveVoxelMask> inputMask;
+    if (!maskPath.empty()) {
+        inputMask.reset(new ActiveVoxelMask(ActiveVoxelMask::load(maskPath)));
+        if (!inputMask->matches(dims)) {
+            throw std::runtime_error("Mask does not match tensor image: " + maskPath);
+        }
+        std::cout << "Solving " << inputMask->activeCount() << " of " << inputMask->voxelCount() << " voxels" << std::endl;
+    }
+
+    const bool needFA = !outputs.faPath.empty() || !outputs.activeMaskPath.empty();
+    const bool needMD = !outputs.mdPath.empty();
+    const bool needEigenvalues = !outputs.eigenvaluesPath.empty();
+    const bool needVectors = !outputs.eigenvectorPath.empty();
+    const bool needTrackerVectors = !outputs.eigenvectorVolumePath.empty();
+
+    // a map whose format cannot paste slabs (e.g. NRRD) is kept whole and written once at the end
+    const bool wholeFA = memoryBudgetBytes > 0 && !outputs.faPath.empty() && !CanStreamWrite(outputs.faPath);
+    const bool wholeMD = memoryBudgetBytes > 0 && needMD && !CanStreamWrite(outputs.mdPath);
+    const bool wholeEigenvalues = memoryBudgetBytes > 0 && needEigenvalues && !CanStreamWrite(outputs.eigenvaluesPath);
+    const bool wholeVectors = memoryBudgetBytes > 0 && needVectors && !CanStreamWrite(outputs.eigenvectorPath);
+
+    // split into z-slabs that fit what the whole maps leave of the budget
+    size_t bytesPerVoxel = TensorBytesPerVoxel;
+    bytesPerVoxel += needFA && !wholeFA ? sizeof(RealType) : 0;
+    bytesPerVoxel += needMD && !wholeMD ? sizeof(RealType) : 0;
+    bytesPerVoxel += needEigenvalues && !wholeEigenvalues ? sizeof(VectorType) : 0;
+    bytesPerVoxel += needVectors && !wholeVectors ? sizeof(EigenvectorType) : 0;
+    bytesPerVoxel += needTrackerVectors ? sizeof(VectorType) : 0;
+    size_t wholeBytesPerVoxel = 0;
+    wholeBytesPerVoxel += wholeFA ? sizeof(RealType) : 0;
+    wholeBytesPerVoxel += wholeMD ? sizeof(RealType) : 0;
+    wholeBytesPerVoxel += wholeEigenvalues ? sizeof(VectorType) : 0;
+    wholeBytesPerVoxel += wholeVectors ? sizeof(EigenvectorType) : 0;
+
+    unsigned int requestedSlabs = 1;
+    if (memoryBudgetBytes > 0) {
+        const size_t wholeBytes = region.GetNumberOfPixels() * wholeBytesPerVoxel;
+        if (wholeBytes > 0) {
+            std::cout << "Output format cannot be written in slabs; keeping " << wholeBytes << " bytes of maps in memory" << std::endl;
+        }
+        const size_t slabBudget = memoryBudgetBytes > wholeBytes ? memoryBudgetBytes - wholeBytes : 1;
+        const size_t totalBytes = region.GetNumberOfPixels() * bytesPerVoxel;
+        requestedSlabs = static_cast<unsigned int>(std::min<size_t>(region.GetSize(2), (totalBytes + slabBudget - 1) / slabBudget));
+        requestedSlabs = std::max(1u, requestedSlabs);
+    }
+    auto splitter = itk::ImageRegionSplitterSlowDimension::New();
+    const unsigned int numSlabs = splitter->GetNumberOfSplits(region, requestedSlabs);
+    const bool streaming = numSlabs > 1;
+    if (streaming) {
+        std::cout << "Streaming " << numSlabs << " slabs within a budget of " << memoryBudgetBytes << " bytes" << std::endl;
+    }
+
+    ActiveVoxelMask activeMask(dims);
+
+    std::unique_ptr<VolumeFileWriter> volumeWriter;
+    if (!outputs.eigenvectorVolumePath.empty()) {
+        volumeWriter.reset(new VolumeFileWriter(outputs.eigenvectorVolumePath, MakeEigenvectorHeader(tensorImage)));
+    }
+
+    // background voxels are skipped when masked, so they must start out zero
+    const bool zeroFill = inputMask != nullptr;
+    ScalarImageType::Pointer faWhole = AllocateSlab<ScalarImageType>(tensorImage, region, wholeFA, zeroFill);
+    ScalarImageType::Pointer mdWhole = AllocateSlab<ScalarImageType>(tensorImage, region, wholeMD, zeroFill);
+    VectorImageType::Pointer eigenvaluesWhole = AllocateSlab<VectorImageType>(tensorImage, region, wholeEigenvalues, zeroFill);
+    EigenvectorImageType::Pointer eigenvectorWhole = AllocateSlab<EigenvectorImageType>(tensorImage, region, wholeVectors, zeroFill);
+
+    for (unsigned int s = 0; s < numSlabs; ++s) {
+        RegionType slab = region;
+        splitter->GetSplit(s, numSlabs, slab);
+
+        // read DTI slab
+        tensorImage->SetRequestedRegion(slab);
+        reader->Update();
+
+        ScalarImageType::Pointer faImage = wholeFA ? faWhole : AllocateSlab<ScalarImageType>(tensorImage, slab, needFA, zeroFill);
+        ScalarImageType::Pointer mdImage = wholeMD ? mdWhole : AllocateSlab<ScalarImageType>(tensorImage, slab, needMD, zeroFill);
+        VectorImageType::Pointer eigenvaluesImage =
+            wholeEigenvalues ? eigenvaluesWhole : AllocateSlab<VectorImageType>(tensorImage, slab, needEigenvalues, zeroFill);
+        EigenvectorImageType::Pointer eigenvectorImage =
+            wholeVectors ? eigenvectorWhole : AllocateSlab<EigenvectorImageType>(tensorImage, slab, needVectors, zeroFill);
+        VectorImageType::Pointer trackerEigenvectorImage = AllocateSlab<VectorImageType>(tensorImage, slab, needTrackerVectors, zeroFill);
+
+        MapBuffers maps;
+        maps.fa = SlabBuffer(faImage.GetPointer(), slab);
+        maps.md = SlabBuffer(mdImage.GetPointer(), slab);
+        maps.eigenvalues = SlabBuffer(eigenvaluesImage.GetPointer(), slab);
+        maps.eigenvector = SlabBuffer(eigenvectorImage.GetPointer(), slab);
+        maps.trackerEigenvector = SlabBuffer(trackerEigenvectorImage.GetPointer(), slab);
+
+        if (inputMask) {
+            SolveSlabMasked(tensorImage, slab, *inputMask, region, maps);
+        } else {
+            SolveSlab(tensorImage, slab, maps);
+        }
+        RunMetrics::add(MetricCounter::VoxelsProcessed, slab.GetNumberOfPixels());
+
+        const uint64_t firstVoxel = static_cast<uint64_t>(slab.GetIndex(2) - region.GetIndex(2)) * region.GetSize(0) * region.GetSize(1);
+        if (!outputs.activeMaskPath.empty()) {
+            activeMask.appendValues(firstVoxel, maps.fa, slab.GetNumberOfPixels(), outputs.activeMaskMinFA);
+        }
+
+        // save this slab before reading the next one
+        if (!wholeFA) {
+            WriteSlab(faImage.GetPointer(), outputs.faPath, slab, streaming);
+        }
+        if (!wholeMD) {
+            WriteSlab(mdImage.GetPointer(), outputs.mdPath, slab, streaming);
+        }
+        if (!wholeEigenvalues) {
+            WriteSlab(eigenvaluesImage.GetPointer(), outputs.eigenvaluesPath, slab, streaming);
+        }
+        if (!wholeVectors) {
+            WriteSlab(eigenvectorImage.GetPointer(), outputs.eigenvectorPath, slab, streaming);
+        }
+
+        if (volumeWriter) {
+            // z-slabs are contiguous in the x-fastest container, so the e1 slab is the payload slice
+            volumeWriter->writeVoxels(firstVoxel, maps.trackerEigenvector, slab.GetNumberOfPixels());
+        }
+    }
+
+    if (wholeFA) {
+        WriteSlab(faWhole.GetPointer(), outputs.faPath, region, false);
+    }
+    if (wholeMD) {
+        WriteSlab(mdWhole.GetPointer(), outputs.mdPath, region, false);
+    }
+    if (wholeEigenvalues) {
+        WriteSlab(eigenvaluesWhole.GetPointer(), outputs.eigenvaluesPath, region, false);
+    }
+    if (wholeVectors) {
+        WriteSlab(eigenvectorWhole.GetPointer(), outputs.eigenvectorPath, region, false);
+    }
+
+    if (volumeWriter) {
+        volumeWriter->close();
+    }
+    if (!outputs.activeMaskPath.empty()) {
+        activeMask.save(outputs.activeMaskPath);
+        std::cout << "Active voxel mask saved to " << outputs.activeMaskPath << " (" << activeMask.activeCount()
+                  << " of " << activeMask.voxelCount() << " voxels)" << std::endl;
+    }
+
+    std::cout << "Task completed: Tensor maps computed" << std::endl;
+}
+
+TensorMapImages ComputeTensorMapImages(const std::string &tensorImagePath)
+{
+    std::cout << "Task started: Computing tensor maps in memory" << std::endl;
+    StageTimer timer("tensor_maps");
+
+    auto reader = itk::ImageFileReader<TensorImageType>::New();
+    reader->SetFileName(tensorImagePath);
+    reader->Update();
+
+    TensorImageType::Pointer tensorImage = reader->GetOutput();
+    const RegionType region = tensorImage->GetLargestPossibleRegion();
+
+    TensorMapImages images;
+    images.fa = AllocateSlab<ScalarImageType>(tensorImage, region, true, false);
+    images.eigenvector = AllocateSlab<VectorImageType>(tensorImage, region, true, false);
+
+    MapBuffers maps;
+    maps.fa = images.fa->GetBufferPointer();
+    maps.md = nullptr;
+    maps.eigenvalues = nullptr;
+    maps.eigenvector = nullptr;
+    maps.trackerEigenvector = images.eigenvector->GetBufferPointer();
+    images.eigenvectorHeader = MakeEigenvectorHeader(tensorImage);
+    SolveSlab(tensorImage, region, maps);
+    RunMetrics::add(MetricCounter::VoxelsProcessed, region.GetNumberOfPixels());
+
+    std::cout << "Task completed: Tensor maps computed" << std::endl;
+    return images;
+}
@@ -0,0 +1,42 @@
+#ifndef COMPUTE_TENSOR_MAPS_H
+#define COMPUTE_TENSOR_MAPS_H
+
+#include "VolumeFile.h"
+#include <itkImage.h>
+#include <itkVector.h>
+#include <cstddef>
+#include <string>
+
+// Output files of ComputeTensorMaps; an empty path skips that map.
+struct TensorMapOutputs {
+    std::string faPath;
+    std::string mdPath;
+    std::string eigenvaluesPath;
+    std::string eigenvectorPath;
+    std::string eigenvectorVolumePath; // VolumeFile container read by the trackers
+    std::string activeMaskPath;        // ActiveVoxelMask of voxels with FA > activeMaskMinFA
+    float activeMaskMinFA = 0.0f;
+};
+
+// Reads the tensor image once and computes FA, MD, eigenvalues and e1 in a single multithreaded pass.
+// With a non-zero memoryBudgetBytes the volume is streamed in z-slabs sized to stay under the budget,
+// and each slab is written as soon as it is done. Bounded memory needs streamable formats on both
+// sides (e.g. uncompressed .mha/.mhd). A tensor file that cannot be read in parts is read whole;
+// a map whose format cannot be written in parts (e.g. NRRD) is kept whole and written at the end,
+// and the slabs are sized to what it leaves of the budget.
+// With maskPath set (an ActiveVoxelMask file), only active voxels are solved and the rest stay zero.
+// Tensors are read and solved in double (float with -DTENSOR_SOLVE_FLOAT). FA, MD and eigenvalues are
+// stored as float, the e1 map as itk::Vector<double, 3>, and the VolumeFile container as float32.
+void ComputeTensorMaps(const std::string &tensorImagePath, const TensorMapOutputs &outputs, size_t memoryBudgetBytes = 0, const std::string &maskPath = "");
+
+// FA and e1 kept as whole in-memory images, for pipelines that go on to tracking without files.
+struct TensorMapImages {
+    itk::Image<float, 3>::Pointer fa;
+    itk::Image<itk::Vector<float, 3>, 3>::Pointer eigenvector;
+    VolumeHeader eigenvectorHeader; // what eigenvectorVolumePath would have been written with
+};
+
+// Same solver as ComputeTensorMaps over the whole volume; nothing is written.
+TensorMapImages ComputeTensorMapImages(const std::string &tensorImagePath);
+
+#endif
@@ -0,0 +1,94 @@
+#include "FiberPolyData.h"
+#include <vtkPoints.h>
+#include <vtkCellArray.h>
+#include <vtkFloatArray.h>
+#include <vtkIdTypeArray.h>
+#include <vtkUnsignedCharArray.h>
+#include <vtkPointData.h>
+#include <vtkPolyDataMapper.h>
+#include <vtkProperty.h>
+
+namespace {
+
+// colourPosition(i) in [0, 1] picks point i's colour on the red -> blue gradient
+template <typename ColourPosition>
+vtkSmartPointer<vtkPolyData> buildPolyData(const Tractogram& fibers, ColourPosition colourPosition) {
+    const vtkIdType numPoints = static_cast<vtkIdType>(fibers.pointCount());
+    const vtkIdType numCells = static_cast<vtkIdType>(fibers.size());
+    const std::vector<uint64_t>& offsets = fibers.offsets();
+
+    // the arena is already an AOS xyz float array, VTK's own point type;
+    // save = 1: VTK never frees or writes it
+    auto coordinates = vtkSmartPointer<vtkFloatArray>::New();
+    coordinates->SetNumberOfComponents(3);
+    coordinates->SetArray(const_cast<float*>(numPoints == 0 ? nullptr : fibers.points()[0].data()), numPoints * 3, 1);
+    auto vtkpoints = vtkSmartPointer<vtkPoints>::New();
+    vtkpoints->SetData(coordinates);
+
+    auto cellOffsets = vtkSmartPointer<vtkIdTypeArray>::New();
+    cellOffsets->SetNumberOfValues(numCells + 1);
+    vtkIdType* offsetData = cellOffsets->GetPointer(0);
+    offsetData[0] = 0;
+    for (vtkIdType i = 0; i < numCells; i++) {
+        offsetData[i + 1] = static_cast<vtkIdType>(offsets[i + 1]);
+    }
+
+    // polylines over consecutive points: connectivity is the identity
+    auto connectivity = vtkSmartPointer<vtkIdTypeArray>::New();
+    connectivity->SetNumberOfValues(numPoints);
+    vtkIdType* connectivityData = connectivity->GetPointer(0);
+    for (vtkIdType i = 0; i < numPoints; i++) {
+        connectivityData[i] = i;
+    }
+
+    auto lines = vtkSmartPointer<vtkCellArray>::New();
+    lines->SetData(cellOffsets, connectivity);
+
+    auto colors = vtkSmartPointer<vtkUnsignedCharArray>::New();
+    colors->SetNumberOfComponents(3);
+    colors->SetName("Colors");
+    colors->SetNumberOfTuples(numPoints);
+    unsigned char* rgb = colors->GetPointer(0);
+    for (vtkIdType i = 0; i < numPoints; i++) {
+        double ratio = colourPosition(i);
+        rgb[3 * i] = static_cast<unsigned char>((1.0 - ratio) * 255);
+        rgb[3 * i + 1] = 0;
+        rgb[3 * i + 2] = static_cast<unsigned char>(ratio * 255);
+    }
+
+    auto polyData = vtkSmartPointer<vtkPolyData>::New();
+    polyData->SetPoints(vtkpoints);
+    polyData->SetLines(lines);
+    polyData->GetPointData()->SetScalars(colors);
+    return polyData;
+}
+
+}
+
+vtkSmartPointer<vtkPolyData> buildFiberPolyData(const Tractogram& fibers) {
+    const double scale = fibers.pointCount() > 1 ? 1.0 / (fibers.pointCount() - 1) : 0.0;
+    return buildPolyData(fibers, [&](vtkIdType i) { return i * scale; });
+}
+
+vtkSmartPointer<vtkPolyData> buildFiberPolyData(const SimplifiedTractogram& level, uint64_t fullPointCount) {
+    const double scale = fullPointCount > 1 ? 1.0 / (fullPointCount - 1) : 0.0;
+    return buildPolyData(level.fibers, [&](vtkIdType i) { return level.sourcePoints[i] * scale; });
+}
+
+vtkSmartPointer<vtkLODProp3D> buildFiberLODProp(const Tractogram& fibers, const std::vector<SimplifiedTractogram>& levels,
+                                                double lineWidth) {
+    auto property = vtkSmartPointer<vtkProperty>::New();
+    property->SetLineWidth(lineWidth);
+
+    auto prop = vtkSmartPointer<vtkLODProp3D>::New();
+    for (size_t level = 0; level <= levels.size(); level++) {
+        auto mapper = vtkSmartPointer<vtkPolyDataMapper>::New();
+        mapper->SetInputData(level == 0 ? buildFiberPolyData(fibers) : buildFiberPolyData(levels[level - 1], fibers.pointCount()));
+        // no time estimate: each level is timed on its first render
+        int id = prop->AddLOD(mapper, property, 0.0);
+        // lower level = finer; preferred whenever its measured time fits
+        prop->SetLODLevel(id, static_cast<double>(level));
+    }
+    prop->AutomaticLODSelectionOn();
+    return prop;
+}
\ No newline at end of file
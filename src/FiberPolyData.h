@@ -0,0 +1,30 @@
+#ifndef FIBER_POLY_DATA_H
+#define FIBER_POLY_DATA_H
+
+#include <vtkSmartPointer.h>
+#include <vtkPolyData.h>
+#include <vtkLODProp3D.h>
+#include "Tractogram.h"
+#include "StreamlineLOD.h"
+#include <cstdint>
+#include <vector>
+
+// Builds renderable geometry for a tractogram in one bulk pass: the float32
+// arena is wrapped as the vtkPoints storage without a copy, each streamline
+// becomes one polyline cell, and the red -> blue gradient colours are written
+// straight into the colour array.
+// fibers must stay alive and unmodified for as long as the polydata is rendered.
+vtkSmartPointer<vtkPolyData> buildFiberPolyData(const Tractogram& fibers);
+
+// A decimated level, coloured as the full tractogram of fullPointCount points it came from.
+vtkSmartPointer<vtkPolyData> buildFiberPolyData(const SimplifiedTractogram& level, uint64_t fullPointCount);
+
+// Full detail plus the coarser levels (finest first) as one prop. vtkLODProp3D
+// times each level as it draws and picks the finest one that fits the frame
+// time the interactor allows: its desired update rate while the view moves,
+// its still update rate (full detail) once it stops.
+// fibers and levels must outlive the prop, as for buildFiberPolyData.
+vtkSmartPointer<vtkLODProp3D> buildFiberLODProp(const Tractogram& fibers, const std::vector<SimplifiedTractogram>& levels,
+                                                double lineWidth);
+
+#endif // FIBER_POLY_DATA_H
\ No newline at end of file
@@ -1,9 +1,4 @@
 #include "FreeFiberTrack.h"
-#include <vtkNrrdReader.h>
-#include <vtkRenderer.h>
-#include <vtkRenderWindow.h>
-#include <vtkRenderWindowInteractor.h>
-#include <vtkPolyData.h>
 #include <vtkPoints.h>
 #include <vtkCellArray.h>
 #include <vtkPolyDataMapper.h>
@@ -11,15 +6,11 @@
 #include <vtkProperty.h>
 #include <vtkCoordinate.h>
 #include <vtkSphereSource.h>
-#include <vtkLine.h>
-#include <queue>
-#include <fstream>
+#include <vtkGlyph3D.h>
+#include <vtkCellData.h>
+#include <vtkCommand.h>
 vtkStandardNewMacro(CustomInteractorStyle);
 
-// 全局变量定义
-std::array<double, 3> SeedPoint = {72, 72, 34};
-bool SeedPointUpdated = false;
-
 void CustomInteractorStyle::OnLeftButtonDown() {
     int* clickPos = this->GetInteractor()->GetEventPosition();
 
@@ -28,25 +19,21 @@ void CustomInteractorStyle::OnLeftButtonDown() {
     coordinate->SetValue(clickPos[0], clickPos[1], 0);
 
     double* worldPos = coordinate->GetComputedWorldValue(this->GetCurrentRenderer());
-    SeedPoint = {worldPos[0], worldPos[1], worldPos[2]};
-    SeedPointUpdated = true;
-    printf("Seed point: [%.1f, %.1f, %.1f]\n", SeedPoint[0], SeedPoint[1], SeedPoint[2]);
+    if (tracker) {
+        tracker->requestFiber({worldPos[0], worldPos[1], worldPos[2]});
+    }
 
     vtkInteractorStyleTrackballCamera::OnLeftButtonDown();
 }
 
 FreeFiberTrack::FreeFiberTrack(const char* vectorBinFile, const char* faFile)
-    : alpha(0.5), stepSize(1.0) {
-    std::ifstream binFile(vectorBinFile, std::ios::binary);
-    size_t totalElements = dimensions[0] * dimensions[1] * dimensions[2] * 3;
-    vectorData.resize(totalElements);
-    binFile.read(reinterpret_cast<char*>(vectorData.data()), totalElements * sizeof(float));
-    binFile.close();
-
-    auto faReader = vtkSmartPointer<vtkNrrdReader>::New();
-    faReader->SetFileName(faFile);
-    faReader->Update();
-    faImage = faReader->GetOutput();
+    : seedWorker([this](const std::array<double, 3>& seed, std::vector<std::array<double, 3>>& points) {
+          integrator.trace(seed, points);
+      }),
+      resultTimer(-1) {
+    volume = VolumeStore::openDirectionFAVolume(vectorBinFile, faFile);
+    activeMask = VolumeStore::openActiveMask(vectorBinFile, *volume);
+    integrator = StreamlineIntegrator(volume->sampler(), activeMask.get());
 }
 
 std::array<double, 3> FreeFiberTrack::generateColor(int trackIndex) {
@@ -58,127 +45,152 @@ std::array<double, 3> FreeFiberTrack::generateColor(int trackIndex) {
 }
 
 void FreeFiberTrack::setParameters(double newAlpha, double newStepSize) {
-    alpha = newAlpha;
-    stepSize = newStepSize;
+    StreamlineParameters params = integrator.getParameters();
+    params.minFA = newAlpha;
+    params.stepSize = newStepSize;
+    integrator.setParameters(params);
+}
+
+void FreeFiberTrack::setStreamlineParameters(const StreamlineParameters& params) {
+    integrator.setParameters(params);
 }
 
-bool FreeFiberTrack::isInside(const std::array<double, 3>& point) {
-    return point[0] >= 0 && point[0] < dimensions[0] &&
-           point[1] >= 0 && point[1] < dimensions[1] &&
-           point[2] >= 0 && point[2] < dimensions[2];
+void FreeFiberTrack::traceFiber(const std::array<double, 3>& seed) {
+    std::vector<std::array<double, 3>> points;
+    integrator.trace(seed, points);
+    addTrack(seed, points);
 }
 
-double FreeFiberTrack::getFAValue(const std::array<double, 3>& point) {
-    return faImage->GetScalarComponentAsDouble(
-        static_cast<int>(point[0]),
-        static_cast<int>(point[1]),
-        static_cast<int>(point[2]),
-        0
-    );
+void FreeFiberTrack::requestFiber(const std::array<double, 3>& seed) {
+    seedWorker.submit(seed);
 }
 
-std::array<double, 3> FreeFiberTrack::getVector(const std::array<double, 3>& point) {
-    int x = static_cast<int>(point[0]);
-    int y = static_cast<int>(point[1]);
-    int z = static_cast<int>(point[2]);
+void FreeFiberTrack::addTrack(const std::array<double, 3>& seed, const std::vector<std::array<double, 3>>& points) {
+    printf("Seed point: [%.1f, %.1f, %.1f]\n", seed[0], seed[1], seed[2]);
+    if (points.empty()) {
+        return;
+    }
 
-    size_t baseIdx = (x * dimensions[1] * dimensions[2] + y * dimensions[2] + z) * 3;
-    std::array<double, 3> vec;
-    for(int i = 0; i < 3; i++) {
-        vec[i] = vectorData[baseIdx + i];
+    fibers.append(points.data(), points.size());
+    fiberSeeds.push_back(seed);
+    if (renderWindow) {
+        appendToScene(fibers.size() - 1);
+        renderWindow->Render();
     }
-    return vec;
 }
 
-void FreeFiberTrack::traceFiber(const std::array<double, 3>& seed) {
-    printf("Seed point: [%.1f, %.1f, %.1f]\n", seed[0], seed[1], seed[2]);
+// timer tick on the UI thread: pick up whatever the worker finished
+void FreeFiberTrack::collectFibers(vtkObject*, unsigned long, void*) {
+    for (auto& traced : seedWorker.takeResults()) {
+        addTrack(traced.seed, traced.points);
+    }
+}
 
-    FiberTrack newTrack;
-    newTrack.color = generateColor(fiberTracks.size());
+void FreeFiberTrack::createScene() {
+    // fibers: one polydata, one polyline cell and one colour per track
+    fiberColors = vtkSmartPointer<vtkUnsignedCharArray>::New();
+    fiberColors->SetNumberOfComponents(3);
+    fiberColors->SetName("Colors");
 
-    std::queue<std::array<double, 3>> q;
-    q.push(seed);
+    fiberPolyData = vtkSmartPointer<vtkPolyData>::New();
+    fiberPolyData->SetPoints(vtkSmartPointer<vtkPoints>::New());
+    fiberPolyData->SetLines(vtkSmartPointer<vtkCellArray>::New());
+    fiberPolyData->GetCellData()->SetScalars(fiberColors);
 
-    while (!q.empty() && newTrack.points.size() < MAX_STEPS) {
-        auto currentPoint = q.front();
-        q.pop();
-        newTrack.points.push_back(currentPoint);
-        auto vec = getVector(currentPoint);
+    auto fiberMapper = vtkSmartPointer<vtkPolyDataMapper>::New();
+    fiberMapper->SetInputData(fiberPolyData);
 
-        for (int direction : {-1, 1}) {
-            std::array<double, 3> nextPoint;
-            for (int i = 0; i < 3; i++) {
-                nextPoint[i] = currentPoint[i] + stepSize * vec[i] * direction;
-            }
+    auto fiberActor = vtkSmartPointer<vtkActor>::New();
+    fiberActor->SetMapper(fiberMapper);
+    fiberActor->GetProperty()->SetLineWidth(2.0);
 
-            if (!isInside(nextPoint) || getFAValue(nextPoint) < alpha) {
-                continue;
-            }
+    // seeds: one sphere glyph per seed point, all in a single actor
+    seedPolyData = vtkSmartPointer<vtkPolyData>::New();
+    seedPolyData->SetPoints(vtkSmartPointer<vtkPoints>::New());
 
-            q.push(nextPoint);
-        }
-    }
+    auto sphere = vtkSmartPointer<vtkSphereSource>::New();
+    sphere->SetRadius(1.0);
 
-    fiberTracks.push_back(newTrack);
-}
+    auto glyphs = vtkSmartPointer<vtkGlyph3D>::New();
+    glyphs->SetInputData(seedPolyData);
+    glyphs->SetSourceConnection(sphere->GetOutputPort());
+    glyphs->ScalingOff();
+    glyphs->OrientOff();
 
-void FreeFiberTrack::visualize() {
-    auto renderer = vtkSmartPointer<vtkRenderer>::New();
-    renderer->SetBackground(0.1, 0.1, 0.1);
+    auto seedMapper = vtkSmartPointer<vtkPolyDataMapper>::New();
+    seedMapper->SetInputConnection(glyphs->GetOutputPort());
 
-    for(const auto& track : fiberTracks) {
-        // Create fiber line
-        auto points = vtkSmartPointer<vtkPoints>::New();
-        auto cells = vtkSmartPointer<vtkCellArray>::New();
-
-        for(size_t i = 0; i < track.points.size(); i++) {
-            points->InsertNextPoint(track.points[i].data());
-            if(i > 0) {
-                auto line = vtkSmartPointer<vtkLine>::New();
-                line->GetPointIds()->SetId(0, i-1);
-                line->GetPointIds()->SetId(1, i);
-                cells->InsertNextCell(line);
-            }
-        }
-
-        auto polyData = vtkSmartPointer<vtkPolyData>::New();
-        polyData->SetPoints(points);
-        polyData->SetLines(cells);
-
-        auto mapper = vtkSmartPointer<vtkPolyDataMapper>::New();
-        mapper->SetInputData(polyData);
-
-        auto actor = vtkSmartPointer<vtkActor>::New();
-        actor->SetMapper(mapper);
-        actor->GetProperty()->SetColor(track.color[0], track.color[1], track.color[2]);
-        actor->GetProperty()->SetLineWidth(2.0);
-        renderer->AddActor(actor);
-
-        // Add sphere at start point
-        auto sphere = vtkSmartPointer<vtkSphereSource>::New();
-        sphere->SetCenter(track.points[0].data());
-        sphere->SetRadius(1.0);
-
-        auto sphereMapper = vtkSmartPointer<vtkPolyDataMapper>::New();
-        sphereMapper->SetInputConnection(sphere->GetOutputPort());
-
-        auto sphereActor = vtkSmartPointer<vtkActor>::New();
-        sphereActor->SetMapper(sphereMapper);
-        sphereActor->GetProperty()->SetColor(1.0, 1.0, 1.0);
-        renderer->AddActor(sphereActor);
-    }
+    auto seedActor = vtkSmartPointer<vtkActor>::New();
+    seedActor->SetMapper(seedMapper);
+    seedActor->GetProperty()->SetColor(1.0, 1.0, 1.0);
 
-    auto renderWindow = vtkSmartPointer<vtkRenderWindow>::New();
+    renderer = vtkSmartPointer<vtkRenderer>::New();
+    renderer->SetBackground(0.1, 0.1, 0.1);
+    renderer->AddActor(fiberActor);
+    renderer->AddActor(seedActor);
+
+    renderWindow = vtkSmartPointer<vtkRenderWindow>::New();
     renderWindow->AddRenderer(renderer);
     renderWindow->SetSize(800, 800);
     renderWindow->SetWindowName("Single voxel VTK");
 
-    auto interactor = vtkSmartPointer<vtkRenderWindowInteractor>::New();
+    interactor = vtkSmartPointer<vtkRenderWindowInteractor>::New();
     interactor->SetRenderWindow(renderWindow);
 
     auto style = vtkSmartPointer<CustomInteractorStyle>::New();
+    style->setTracker(this);
     interactor->SetInteractorStyle(style);
 
+    // ~60 Hz poll for finished fibers; the interactor itself never waits on tracing
+    interactor->Initialize();
+    interactor->AddObserver(vtkCommand::TimerEvent, this, &FreeFiberTrack::collectFibers);
+
+    for (size_t i = 0; i < fibers.size(); i++) {
+        appendToScene(i);
+    }
+}
+
+// cost is the new track only, however many tracks are already shown
+void FreeFiberTrack::appendToScene(size_t fiberIndex) {
+    vtkPoints* points = fiberPolyData->GetPoints();
+    vtkCellArray* lines = fiberPolyData->GetLines();
+
+    const Tractogram::Point* fiber = fibers.streamline(fiberIndex);
+    std::vector<vtkIdType> ids(fibers.streamlineSize(fiberIndex));
+    for (size_t i = 0; i < ids.size(); i++) {
+        ids[i] = points->InsertNextPoint(fiber[i].data());
+    }
+    lines->InsertNextCell(static_cast<vtkIdType>(ids.size()), ids.data());
+
+    const std::array<double, 3> color = generateColor(static_cast<int>(fiberIndex));
+    const unsigned char rgb[3] = {static_cast<unsigned char>(color[0] * 255),
+                                  static_cast<unsigned char>(color[1] * 255),
+                                  static_cast<unsigned char>(color[2] * 255)};
+    fiberColors->InsertNextTypedTuple(rgb);
+
+    // seed is where the streamline was started, not its first (backward) end
+    vtkPoints* seeds = seedPolyData->GetPoints();
+    seeds->InsertNextPoint(fiberSeeds[fiberIndex].data());
+
+    points->Modified();
+    lines->Modified();
+    fiberColors->Modified();
+    fiberPolyData->Modified();
+    seeds->Modified();
+    seedPolyData->Modified();
+}
+
+void FreeFiberTrack::visualize() {
+    if (!renderWindow) {
+        createScene();
+    }
+    if (resultTimer < 0) {
+        resultTimer = interactor->CreateRepeatingTimer(16);
+    }
+
     renderWindow->Render();
     interactor->Start();
+
+    interactor->DestroyTimer(resultTimer);
+    resultTimer = -1;
 }
\ No newline at end of file
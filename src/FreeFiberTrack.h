@@ -3,49 +3,73 @@
 
 #include <vtkSmartPointer.h>
 #include <vtkImageData.h>
+#include <vtkPolyData.h>
+#include <vtkRenderer.h>
+#include <vtkRenderWindow.h>
+#include <vtkRenderWindowInteractor.h>
+#include <vtkUnsignedCharArray.h>
+#include "VolumeStore.h"
+#include "StreamlineIntegrator.h"
+#include "AsyncSeedTracker.h"
+#include "Tractogram.h"
 #include <vtkInteractorStyleTrackballCamera.h>
 #include <vtkObjectFactory.h>
 #include <array>
 #include <vector>
 
-// 全局变量声明
-extern std::array<double, 3> SeedPoint;
-extern bool SeedPointUpdated;
-
-// 纤维追踪数据结构
-struct FiberTrack {
-    std::vector<std::array<double, 3>> points;
-    std::array<double, 3> color;
-};
+class FreeFiberTrack;
 
 // 自定义交互器类
+// A left click seeds a new fiber in the tracker's scene, traced in the background.
 class CustomInteractorStyle : public vtkInteractorStyleTrackballCamera {
+private:
+    FreeFiberTrack* tracker = nullptr;
+
 public:
     static CustomInteractorStyle* New();
     vtkTypeMacro(CustomInteractorStyle, vtkInteractorStyleTrackballCamera);
+    void setTracker(FreeFiberTrack* freeFiberTrack) { tracker = freeFiberTrack; }
     virtual void OnLeftButtonDown() override;
 };
 
 // 主要的纤维追踪类
 class FreeFiberTrack {
 private:
-    std::vector<float> vectorData;
-    vtkSmartPointer<vtkImageData> faImage;
-    std::vector<FiberTrack> fiberTracks;
-    double alpha;
-    double stepSize;
-    const int dimensions[3] = {144, 144, 85};
-    const int MAX_STEPS = 200000;
+    std::shared_ptr<const DirectionFAVolume> volume;
+    std::shared_ptr<const ActiveVoxelMask> activeMask;
+    // fiber i was seeded at fiberSeeds[i] and is drawn in generateColor(i)
+    Tractogram fibers;
+    std::vector<std::array<double, 3>> fiberSeeds;
+    StreamlineIntegrator integrator;
+
+    AsyncSeedTracker seedWorker;
+    int resultTimer;
+
+    // persistent scene: one window, one fiber actor with per-cell colour, one seed glyph set
+    vtkSmartPointer<vtkRenderer> renderer;
+    vtkSmartPointer<vtkRenderWindow> renderWindow;
+    vtkSmartPointer<vtkRenderWindowInteractor> interactor;
+    vtkSmartPointer<vtkPolyData> fiberPolyData;
+    vtkSmartPointer<vtkUnsignedCharArray> fiberColors;
+    vtkSmartPointer<vtkPolyData> seedPolyData;
 
     std::array<double, 3> generateColor(int trackIndex);
-    bool isInside(const std::array<double, 3>& point);
-    double getFAValue(const std::array<double, 3>& point);
-    std::array<double, 3> getVector(const std::array<double, 3>& point);
+    void createScene();
+    void appendToScene(size_t fiberIndex);
+    void addTrack(const std::array<double, 3>& seed, const std::vector<std::array<double, 3>>& points);
+    void collectFibers(vtkObject* caller, unsigned long eventId, void* callData);
 
 public:
     FreeFiberTrack(const char* vectorBinFile, const char* faFile);
     void setParameters(double newAlpha, double newStepSize);
+    void setStreamlineParameters(const StreamlineParameters& params);
+    // Traces one fiber on the calling thread; once the scene is shown, only that fiber is added and redrawn.
+    // Parameters must be set before visualize(), while the background worker is idle.
     void traceFiber(const std::array<double, 3>& seed);
+    // Queues a seed for the background worker; the fiber appears on the next timer tick.
+    // A seed still waiting when a newer one arrives is dropped.
+    void requestFiber(const std::array<double, 3>& seed);
+    // Shows the scene and runs the interactor until the window is closed.
     void visualize();
 };
 
@@ -0,0 +1,28 @@
+#include "InMemorySubject.h"
+#include "ItkVtkBridge.h"
+#include "VolumeStore.h"
+
+InMemorySubject::InMemorySubject(const std::string& tensorImagePath, const std::string& subjectName)
+    : vectorName(subjectName + "/e1"), faName(subjectName + "/fa") {
+    maps = ComputeTensorMapImages(tensorImagePath);
+    faImage = WrapITKImage(maps.fa.GetPointer());
+
+    // itk::Vector<float, 3> pixels are packed xyz floats, i.e. an x-fastest 3-component volume
+    auto eigenvectorImage = maps.eigenvector;
+    VectorVolume vectors;
+    vectors.header = maps.eigenvectorHeader;
+    vectors.memory = std::shared_ptr<const void>(eigenvectorImage->GetBufferPointer(), [eigenvectorImage](const void*) {});
+    vectors.data = reinterpret_cast<const float*>(eigenvectorImage->GetBufferPointer());
+    for (int i = 0; i < 3; i++) {
+        vectors.dimensions[i] = static_cast<int>(vectors.header.dimensions[i]);
+    }
+    volumeStrides(vectors.header, vectors.strides);
+
+    VolumeStore::registerVectorVolume(vectorName, vectors);
+    VolumeStore::registerFAImage(faName, faImage);
+}
+
+InMemorySubject::~InMemorySubject() {
+    VolumeStore::release(vectorName);
+    VolumeStore::release(faName);
+}
@@ -0,0 +1,33 @@
+#ifndef IN_MEMORY_SUBJECT_H
+#define IN_MEMORY_SUBJECT_H
+
+#include "ComputeTensorMaps.h"
+#include <vtkSmartPointer.h>
+#include <vtkImageData.h>
+#include <string>
+
+// One subject taken from its tensor image to the trackers and the renderer with no
+// intermediate files. FA and e1 are computed into ITK images and registered with the
+// VolumeStore under vectorPath() and faPath(), so every tracker and VolumeRenderer
+// opens them by name exactly as it would open the files. Nothing is copied on the way:
+// the FA vtkImageData shares the ITK pixel buffer, and the e1 volume is the ITK buffer.
+class InMemorySubject {
+private:
+    std::string vectorName;
+    std::string faName;
+    TensorMapImages maps;
+    vtkSmartPointer<vtkImageData> faImage;
+
+public:
+    // name must be unique among the subjects alive at the same time
+    explicit InMemorySubject(const std::string& tensorImagePath, const std::string& subjectName = "memory:subject");
+    ~InMemorySubject();
+    InMemorySubject(const InMemorySubject&) = delete;
+    InMemorySubject& operator=(const InMemorySubject&) = delete;
+
+    const char* vectorPath() const { return vectorName.c_str(); }
+    const char* faPath() const { return faName.c_str(); }
+    vtkImageData* getFAImage() const { return faImage; }
+};
+
+#endif // IN_MEMORY_SUBJECT_H
@@ -0,0 +1,30 @@
+#include "ItkVtkBridge.h"
+#include <map>
+#include <mutex>
+
+namespace
+{
+// buffers handed to VTK, and the ITK objects owning them
+std::mutex SharedMutex;
+std::multimap<void *, itk::LightObject::Pointer> SharedOwners;
+
+void ReleaseSharedBuffer(void *buffer)
+{
+    std::lock_guard<std::mutex> lock(SharedMutex);
+    auto owner = SharedOwners.find(buffer);
+    if (owner != SharedOwners.end()) {
+        SharedOwners.erase(owner);
+    }
+}
+}
+
+void ShareImageBuffer(vtkFloatArray *array, float *buffer, vtkIdType valueCount, itk::LightObject *owner)
+{
+    {
+        std::lock_guard<std::mutex> lock(SharedMutex);
+        SharedOwners.emplace(buffer, owner);
+    }
+    // VTK calls the free function instead of free()/delete[] once the array lets go of the buffer
+    array->SetArray(buffer, valueCount, 0, vtkAbstractArray::VTK_DATA_ARRAY_USER_DEFINED);
+    array->SetArrayFreeFunction(ReleaseSharedBuffer);
+}
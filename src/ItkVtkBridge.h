@@ -0,0 +1,55 @@
+#ifndef ITK_VTK_BRIDGE_H
+#define ITK_VTK_BRIDGE_H
+
+#include <itkLightObject.h>
+#include <itkNumericTraits.h>
+#include <vtkSmartPointer.h>
+#include <vtkImageData.h>
+#include <vtkFloatArray.h>
+#include <vtkPointData.h>
+#include <stdexcept>
+#include <type_traits>
+
+// Hands buffer to array without copying; owner is held until VTK frees the array.
+void ShareImageBuffer(vtkFloatArray *array, float *buffer, vtkIdType valueCount, itk::LightObject *owner);
+
+// vtkImageData whose scalars are the pixel buffer of a float ITK image (scalar or
+// itk::Vector components), with the same dimensions, spacing and origin; no pixel is copied.
+// The ITK image stays alive as long as VTK holds the scalars, so either side may go first.
+// Like vtkNrrdReader output, the direction cosines are not carried over.
+template <typename TImage>
+vtkSmartPointer<vtkImageData> WrapITKImage(TImage *image)
+{
+    using PixelType = typename TImage::PixelType;
+    constexpr int Components = sizeof(PixelType) / sizeof(float);
+    static_assert(std::is_same<typename itk::NumericTraits<PixelType>::ValueType, float>::value,
+                  "only float pixel buffers can be shared");
+
+    const typename TImage::RegionType &region = image->GetLargestPossibleRegion();
+    if (image->GetBufferedRegion() != region) {
+        throw std::runtime_error("Only a fully buffered image can be wrapped");
+    }
+
+    int dimensions[3];
+    double spacing[3];
+    double origin[3];
+    for (unsigned int i = 0; i < 3; ++i) {
+        dimensions[i] = static_cast<int>(region.GetSize(i));
+        spacing[i] = image->GetSpacing()[i];
+        origin[i] = image->GetOrigin()[i];
+    }
+
+    auto scalars = vtkSmartPointer<vtkFloatArray>::New();
+    scalars->SetNumberOfComponents(Components);
+    ShareImageBuffer(scalars, reinterpret_cast<float *>(image->GetBufferPointer()),
+                     static_cast<vtkIdType>(region.GetNumberOfPixels()) * Components, image);
+
+    auto wrapped = vtkSmartPointer<vtkImageData>::New();
+    wrapped->SetDimensions(dimensions);
+    wrapped->SetSpacing(spacing);
+    wrapped->SetOrigin(origin);
+    wrapped->GetPointData()->SetScalars(scalars);
+    return wrapped;
+}
+
+#endif
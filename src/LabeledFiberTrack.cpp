@@ -1,99 +1,65 @@
 #include "LabeledFiberTrack.h"
+#include "FiberPolyData.h"
+#include "RunMetrics.h"
+#include "StreamlineIndex.h"
 #include <vtkNrrdReader.h>
 #include <vtkRenderer.h>
 #include <vtkRenderWindow.h>
 #include <vtkRenderWindowInteractor.h>
-#include <vtkPolyData.h>
-#include <vtkPoints.h>
-#include <vtkCellArray.h>
-#include <vtkPolyDataMapper.h>
-#include <vtkActor.h>
-#include <vtkProperty.h>
 #include <vtkInteractorStyleTrackballCamera.h>
-#include <vtkLine.h>
-#include <vtkUnsignedCharArray.h>
-#include <vtkPointData.h>
-#include <queue>
-#include <fstream>
+#include <algorithm>
+#include <memory>
 #include <unistd.h>
 
 LabeledFiberTrack::LabeledFiberTrack(const char* vectorBinFile, const char* faFile)
-    : alpha(0.5), stepSize(1.0) {
-    std::ifstream binFile(vectorBinFile, std::ios::binary);
-    size_t totalElements = dimensions[0] * dimensions[1] * dimensions[2] * 3;
-    vectorData.resize(totalElements);
-    binFile.read(reinterpret_cast<char*>(vectorData.data()), totalElements * sizeof(float));
-    binFile.close();
-
-    auto faReader = vtkSmartPointer<vtkNrrdReader>::New();
-    faReader->SetFileName(faFile);
-    faReader->Update();
-    faImage = faReader->GetOutput();
+    : vectorPath(vectorBinFile), faPath(faFile), displayMode(FiberDisplayMode::Final), progressiveView("Single voxel VTK"),
+      writeIndex(false) {
+    volume = VolumeStore::openDirectionFAVolume(vectorBinFile, faFile);
+    activeMask = VolumeStore::openActiveMask(vectorBinFile, *volume);
+    integrator = StreamlineIntegrator(volume->sampler(), activeMask.get());
 }
 
 void LabeledFiberTrack::setParameters(double newAlpha, double newStepSize) {
-    alpha = newAlpha;
-    stepSize = newStepSize;
+    StreamlineParameters params = integrator.getParameters();
+    params.minFA = newAlpha;
+    params.stepSize = newStepSize;
+    integrator.setParameters(params);
 }
 
-bool LabeledFiberTrack::isInside(const std::array<double, 3>& point) {
-    return point[0] >= 0 && point[0] < dimensions[0] &&
-           point[1] >= 0 && point[1] < dimensions[1] &&
-           point[2] >= 0 && point[2] < dimensions[2];
+void LabeledFiberTrack::setStreamlineParameters(const StreamlineParameters& params) {
+    integrator.setParameters(params);
 }
 
-double LabeledFiberTrack::getFAValue(const std::array<double, 3>& point) {
-    return faImage->GetScalarComponentAsDouble(
-        static_cast<int>(point[0]),
-        static_cast<int>(point[1]),
-        static_cast<int>(point[2]),
-        0
-    );
+void LabeledFiberTrack::setDisplayMode(FiberDisplayMode mode, double maxRedrawsPerSecond) {
+    displayMode = mode;
+    progressiveView.setMaxRedrawRate(maxRedrawsPerSecond);
 }
 
-std::array<double, 3> LabeledFiberTrack::getVector(const std::array<double, 3>& point) {
-    int x = static_cast<int>(point[0]);
-    int y = static_cast<int>(point[1]);
-    int z = static_cast<int>(point[2]);
+void LabeledFiberTrack::setOutputFile(const std::string& path) {
+    outputFile = path;
+}
 
-    size_t baseIdx = (x * dimensions[1] * dimensions[2] + y * dimensions[2] + z) * 3;
-    std::array<double, 3> vec;
-    for(int i = 0; i < 3; i++) {
-        vec[i] = vectorData[baseIdx + i];
-    }
-    return vec;
+void LabeledFiberTrack::setWriteIndex(bool enabled) {
+    writeIndex = enabled;
 }
 
-void LabeledFiberTrack::traceFiber(const std::array<double, 3>& seed) {
-    std::queue<std::array<double, 3>> q;
-    q.push(seed);
-    int stepCount = 0;
-
-    while (!q.empty() && stepCount < MAX_STEPS) {
-        auto currentPoint = q.front();
-        q.pop();
-        fiberPoints.push_back(currentPoint);
-        auto vec = getVector(currentPoint);
-
-        for (int direction : {-1, 1}) {
-            std::array<double, 3> nextPoint;
-            for (int i = 0; i < 3; i++) {
-                nextPoint[i] = currentPoint[i] + stepSize * vec[i] * direction;
-            }
+void LabeledFiberTrack::setCache(const std::shared_ptr<const TractogramCache>& tractogramCache) {
+    cache = tractogramCache;
+}
 
-            if (!isInside(nextPoint)) {
-                continue;
-            }
+void LabeledFiberTrack::setNumberOfThreads(unsigned int numThreads) {
+    seedTracker.setNumberOfThreads(numThreads);
+}
 
-            double nextFA = getFAValue(nextPoint);
-            if (nextFA < alpha) {
-                continue;
-            }
+void LabeledFiberTrack::traceFiber(const std::array<double, 3>& seed, std::vector<std::array<double, 3>>& points) const {
+    integrator.trace(seed, points);
+}
 
-            q.push(nextPoint);
-        }
-        visualize();
-        stepCount++;
+void LabeledFiberTrack::finishOutput(TractogramWriter& writer) const {
+    writer.close();
+    if (writeIndex) {
+        StageTimer timer("streamline_index");
+        StreamlineIndex::build(fibers, volume->dimensions, seedTracker.getNumberOfThreads()).save(streamlineIndexPath(outputFile));
     }
 }
 
@@ -105,6 +71,7 @@ std::vector<std::array<double, 3>> LabeledFiberTrack::findSeedPoints(const char*
     labelReader->Update();
     auto labelImage = labelReader->GetOutput();
 
+    const int* dimensions = volume->dimensions;
     for(int x = 0; x < dimensions[0]; x++) {
         for(int y = 0; y < dimensions[1]; y++) {
             for(int z = 0; z < dimensions[2]; z++) {
@@ -121,50 +88,87 @@ std::vector<std::array<double, 3>> LabeledFiberTrack::findSeedPoints(const char*
 }
 
 void LabeledFiberTrack::traceAllFibers(const char* labelFile) {
-    fiberPoints.clear();
+    StageTimer timer("labeled_tracking");
+    fibers.clear();
+    lodLevels.clear();
     auto seedPoints = findSeedPoints(labelFile);
-    for(const auto& seed : seedPoints) {
-        traceFiber(seed);
+    auto trace = [this](const std::array<double, 3>& seed, std::vector<std::array<double, 3>>& points) {
+        traceFiber(seed, points);
+    };
+
+    TractogramCacheKey cacheKey;
+    bool cached = false;
+    if (cache) {
+        cacheKey.addFile(vectorPath);
+        cacheKey.addFile(faPath);
+        cacheKey.addFile(labelFile);
+        // a stored mask decides which seeds are traced; without one it is derived from the FA above
+        const std::string maskPath = VolumeStore::activeMaskPath(vectorPath);
+        if (access(maskPath.c_str(), R_OK) == 0) {
+            cacheKey.addFile(maskPath);
+        } else {
+            cacheKey.addString("no-mask");
+        }
+        cacheKey.addString("labeled");
+        cacheKey.addParameters(integrator.getParameters());
+        cacheKey.addSeeds(seedPoints);
+        cached = cache->load(cacheKey, fibers);
     }
-}
 
-void LabeledFiberTrack::visualize() {
-    auto points = vtkSmartPointer<vtkPoints>::New();
-    auto cells = vtkSmartPointer<vtkCellArray>::New();
-    auto colors = vtkSmartPointer<vtkUnsignedCharArray>::New();
-    colors->SetNumberOfComponents(3);
-    colors->SetName("Colors");
-
-    for(size_t i = 0; i < fiberPoints.size(); i++) {
-        points->InsertNextPoint(fiberPoints[i].data());
-
-        double ratio = static_cast<double>(i) / (fiberPoints.size() - 1);
-        colors->InsertComponent(i, 0, static_cast<unsigned char>((1.0 - ratio) * 255));
-        colors->InsertComponent(i, 1, 0);
-        colors->InsertComponent(i, 2, static_cast<unsigned char>(ratio * 255));
-
-        if(i > 0) {
-            auto line = vtkSmartPointer<vtkLine>::New();
-            line->GetPointIds()->SetId(0, i-1);
-            line->GetPointIds()->SetId(1, i);
-            cells->InsertNextCell(line);
+    // opened only now, so an earlier output survives anything that fails before fibers exist
+    std::unique_ptr<TractogramWriter> writer;
+    if (!outputFile.empty()) {
+        writer.reset(new TractogramWriter(outputFile, makeTractogramHeader(volume->dimensions, volume->voxelToWorld)));
+    }
+
+    if (cached) {
+        if (writer) {
+            writer->writeStreamlines(fibers);
+        }
+    } else {
+        // Trace in rounds, each written out as soon as it finishes. Progressive rounds are small so
+        // a snapshot can be drawn between them; otherwise they are large enough to keep every thread busy.
+        const size_t seedsPerThread = displayMode == FiberDisplayMode::Progressive ? 64 : 1024;
+        const size_t roundSize = seedTracker.getNumberOfThreads() * seedsPerThread;
+        for (size_t first = 0; first < seedPoints.size(); first += roundSize) {
+            size_t last = std::min(first + roundSize, seedPoints.size());
+            std::vector<std::array<double, 3>> roundSeeds(seedPoints.begin() + first, seedPoints.begin() + last);
+            seedTracker.run(roundSeeds, trace, fibers);
+            if (writer) {
+                writer->writeStreamlines(fibers, first, last);
+            }
+
+            if (displayMode == FiberDisplayMode::Progressive && progressiveView.redrawDue()) {
+                progressiveView.redraw(fibers);
+            }
+        }
+        if (cache) {
+            cache->store(cacheKey, fibers);
         }
     }
 
-    auto polyData = vtkSmartPointer<vtkPolyData>::New();
-    polyData->SetPoints(points);
-    polyData->SetLines(cells);
-    polyData->GetPointData()->SetScalars(colors);
+    if (writer) {
+        finishOutput(*writer);
+    }
+    progressiveView.close();
+}
 
-    auto mapper = vtkSmartPointer<vtkPolyDataMapper>::New();
-    mapper->SetInputData(polyData);
+void LabeledFiberTrack::visualize() {
+    if (displayMode == FiberDisplayMode::Headless) {
+        return;
+    }
 
-    auto actor = vtkSmartPointer<vtkActor>::New();
-    actor->SetMapper(mapper);
-    actor->GetProperty()->SetLineWidth(2.0);
+    // coarser copies for interaction, so rotating a dense tractogram stays fluid; once per tractogram
+    if (lodLevels.empty()) {
+        StageTimer timer("fiber_lod");
+        for (const StreamlineLODLevel& level : defaultStreamlineLODLevels()) {
+            lodLevels.push_back(simplifyStreamlines(fibers, level, seedTracker.getNumberOfThreads()));
+        }
+    }
+    auto fiberProp = buildFiberLODProp(fibers, lodLevels, 2.0);
 
     auto renderer = vtkSmartPointer<vtkRenderer>::New();
-    renderer->AddActor(actor);
+    renderer->AddViewProp(fiberProp);
     renderer->SetBackground(0.1, 0.1, 0.1);
 
     auto renderWindow = vtkSmartPointer<vtkRenderWindow>::New();
@@ -174,11 +178,14 @@ void LabeledFiberTrack::visualize() {
 
     auto interactor = vtkSmartPointer<vtkRenderWindowInteractor>::New();
     interactor->SetRenderWindow(renderWindow);
+    // frame rate the LOD prop aims for while the view moves; at rest it draws full detail
+    interactor->SetDesiredUpdateRate(15.0);
+    interactor->SetStillUpdateRate(0.001);
 
     auto style = vtkSmartPointer<vtkInteractorStyleTrackballCamera>::New();
     interactor->SetInteractorStyle(style);
 
+    // interactive until the window is closed: rotating is what the LOD levels are for
     renderWindow->Render();
-    usleep(1000000);
-    renderWindow->Finalize();
+    interactor->Start();
 }
\ No newline at end of file
@@ -3,28 +3,50 @@
 
 #include <vtkSmartPointer.h>
 #include <vtkImageData.h>
+#include "VolumeStore.h"
+#include "StreamlineIntegrator.h"
+#include "ParallelSeedTracker.h"
+#include "ProgressiveFiberView.h"
+#include "TractogramIO.h"
+#include "TractogramCache.h"
+#include "StreamlineLOD.h"
 #include <array>
+#include <memory>
+#include <string>
 #include <vector>
 
 class LabeledFiberTrack {
 private:
-    std::vector<float> vectorData;
-    vtkSmartPointer<vtkImageData> faImage;
-    std::vector<std::array<double, 3>> fiberPoints;
-    double alpha;
-    double stepSize;
-    const int dimensions[3] = {144, 144, 85};
-    const int MAX_STEPS = 200000;
+    std::shared_ptr<const DirectionFAVolume> volume;
+    std::shared_ptr<const ActiveVoxelMask> activeMask;
+    std::string vectorPath;
+    std::string faPath;
+    Tractogram fibers;
+    std::vector<SimplifiedTractogram> lodLevels;    // drawn while the view moves; built by the first visualize()
+    ParallelSeedTracker seedTracker;
+    StreamlineIntegrator integrator;
+    FiberDisplayMode displayMode;
+    ProgressiveFiberView progressiveView;
+    std::string outputFile;
+    bool writeIndex;
+    std::shared_ptr<const TractogramCache> cache;
 
-    bool isInside(const std::array<double, 3>& point);
-    double getFAValue(const std::array<double, 3>& point);
-    std::array<double, 3> getVector(const std::array<double, 3>& point);
-    void traceFiber(const std::array<double, 3>& seed);
+    void traceFiber(const std::array<double, 3>& seed, std::vector<std::array<double, 3>>& points) const;
     std::vector<std::array<double, 3>> findSeedPoints(const char* labelFile);
+    void finishOutput(TractogramWriter& writer) const;
 
 public:
     LabeledFiberTrack(const char* vectorBinFile, const char* faFile);
     void setParameters(double newAlpha, double newStepSize);
+    void setStreamlineParameters(const StreamlineParameters& params);
+    void setNumberOfThreads(unsigned int numThreads);
+    void setDisplayMode(FiberDisplayMode mode, double maxRedrawsPerSecond = 1.0);
+    // .trk or .tck; fibers are streamed there by traceAllFibers, empty disables
+    void setOutputFile(const std::string& path);
+    // also save a voxel -> streamline index of the output, at streamlineIndexPath(outputFile)
+    void setWriteIndex(bool enabled);
+    // reuse fibers from an earlier run with the same inputs, parameters and seeds; null disables
+    void setCache(const std::shared_ptr<const TractogramCache>& tractogramCache);
     void traceAllFibers(const char* labelFile);
     void visualize();
 };
@@ -0,0 +1,38 @@
+#include "MappedFile.h"
+#include "RunMetrics.h"
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(const std::string& path) : address(nullptr), length(0) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot open " + path);
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        close(fd);
+        throw std::runtime_error("Cannot stat " + path);
+    }
+    length = static_cast<size_t>(info.st_size);
+
+    if (length > 0) {
+        address = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+        if (address == MAP_FAILED) {
+            address = nullptr;
+            close(fd);
+            throw std::runtime_error("Cannot map " + path);
+        }
+    }
+    close(fd);
+    RunMetrics::add(MetricCounter::BytesRead, length);
+}
+
+MappedFile::~MappedFile() {
+    if (address) {
+        munmap(address, length);
+    }
+}
\ No newline at end of file
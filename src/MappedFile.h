@@ -0,0 +1,25 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+
+// Read-only memory mapping of a whole file.
+// Pages come straight from the OS page cache, so every tracker and every
+// process that maps the same file shares one physical copy.
+class MappedFile {
+private:
+    void* address;
+    size_t length;
+
+public:
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const void* data() const { return address; }
+    size_t size() const { return length; }
+};
+
+#endif // MAPPED_FILE_H
\ No newline at end of file
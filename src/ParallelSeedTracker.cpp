@@ -0,0 +1,78 @@
+#include "ParallelSeedTracker.h"
+
+ParallelSeedTracker::ParallelSeedTracker(unsigned int numThreads)
+    : numThreads(1), job(nullptr), jobGeneration(0), workersBusy(0), stopping(false) {
+    setNumberOfThreads(numThreads);
+}
+
+ParallelSeedTracker::~ParallelSeedTracker() {
+    stopWorkers();
+}
+
+void ParallelSeedTracker::setNumberOfThreads(unsigned int newNumThreads) {
+    newNumThreads = newNumThreads > 0 ? newNumThreads : std::max(1u, std::thread::hardware_concurrency());
+    if (newNumThreads != numThreads) {
+        stopWorkers();
+        numThreads = newNumThreads;
+    }
+}
+
+unsigned int ParallelSeedTracker::getNumberOfThreads() const {
+    return numThreads;
+}
+
+void ParallelSeedTracker::stopWorkers() {
+    {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        stopping = true;
+    }
+    jobReady.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    workers.clear();
+    stopping = false;
+}
+
+void ParallelSeedTracker::workerLoop(unsigned int threadIndex, uint64_t generation) {
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(poolMutex);
+            jobReady.wait(lock, [&] { return stopping || jobGeneration != generation; });
+            if (stopping) {
+                return;
+            }
+            generation = jobGeneration;
+        }
+        // job stays set until every worker has reported back below
+        (*job)(threadIndex);
+        {
+            std::lock_guard<std::mutex> lock(poolMutex);
+            if (--workersBusy == 0) {
+                jobDone.notify_one();
+            }
+        }
+    }
+}
+
+void ParallelSeedTracker::runOnAllWorkers(const std::function<void(unsigned int)>& work) {
+    if (workers.empty()) {
+        workers.reserve(numThreads - 1);
+        for (unsigned int t = 1; t < numThreads; t++) {
+            workers.emplace_back(&ParallelSeedTracker::workerLoop, this, t, jobGeneration);
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        job = &work;
+        workersBusy = static_cast<unsigned int>(workers.size());
+        jobGeneration++;
+    }
+    jobReady.notify_all();
+
+    work(0);
+
+    std::unique_lock<std::mutex> lock(poolMutex);
+    jobDone.wait(lock, [&] { return workersBusy == 0; });
+    job = nullptr;
+}
\ No newline at end of file
@@ -0,0 +1,121 @@
+#ifndef PARALLEL_SEED_TRACKER_H
+#define PARALLEL_SEED_TRACKER_H
+
+#include "Tractogram.h"
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+// Traces many seeds on a pool of worker threads.
+// Workers pull small batches of seeds from a shared atomic cursor, so a thread
+// that finishes early keeps taking work instead of idling behind a long fiber.
+// Each worker appends into its own chunked float32 buffer and the buffers are
+// stitched together in seed order afterwards, so the output matches a serial run.
+// The pool is started on the first run and its threads sleep between runs, so
+// tracing in many small rounds (progressive display) costs no thread start-up.
+class ParallelSeedTracker {
+public:
+    using Point = std::array<double, 3>;
+
+    explicit ParallelSeedTracker(unsigned int numThreads = 0);
+    ~ParallelSeedTracker();
+    ParallelSeedTracker(const ParallelSeedTracker&) = delete;
+    ParallelSeedTracker& operator=(const ParallelSeedTracker&) = delete;
+
+    // a different count restarts the pool on the next run
+    void setNumberOfThreads(unsigned int newNumThreads);
+    unsigned int getNumberOfThreads() const;
+
+    // trace(seed, out) appends the fiber grown from seed to out, a scratch buffer
+    // reused from seed to seed. The fiber of seeds[i] becomes streamline
+    // fibers.size() + i, so several runs can fill one tractogram back to back.
+    // Not reentrant: the worker chunks and threads are kept for the next run.
+    template <typename TraceFunction>
+    void run(const std::vector<Point>& seeds, TraceFunction trace, Tractogram& fibers);
+
+private:
+    unsigned int numThreads;
+    std::vector<TractogramChunkBuilder> buffers;
+
+    // numThreads - 1 pool threads; the thread calling run is worker 0
+    std::vector<std::thread> workers;
+    std::mutex poolMutex;
+    std::condition_variable jobReady;
+    std::condition_variable jobDone;
+    const std::function<void(unsigned int)>* job;
+    uint64_t jobGeneration;
+    unsigned int workersBusy;
+    bool stopping;
+
+    void stopWorkers();
+    void workerLoop(unsigned int threadIndex, uint64_t generation);
+    // work(t) for every worker t, returning when all are done; work must not throw
+    void runOnAllWorkers(const std::function<void(unsigned int)>& work);
+};
+
+template <typename TraceFunction>
+void ParallelSeedTracker::run(const std::vector<Point>& seeds, TraceFunction trace, Tractogram& fibers) {
+    const size_t seedCount = seeds.size();
+    const unsigned int threadCount = static_cast<unsigned int>(
+        std::max<size_t>(1, std::min<size_t>(numThreads, seedCount)));
+
+    // small batches keep the shared cursor cheap while still balancing load
+    const size_t batchSize = std::max<size_t>(1, std::min<size_t>(64, seedCount / (threadCount * 16)));
+
+    if (buffers.size() < numThreads) {
+        buffers.resize(numThreads);
+    }
+    for (auto& buffer : buffers) {
+        buffer.clear();
+    }
+    std::atomic<size_t> nextSeed(0);
+    std::exception_ptr failure;
+    std::mutex failureMutex;
+
+    std::function<void(unsigned int)> worker = [&](unsigned int threadIndex) {
+        TractogramChunkBuilder& buffer = buffers[threadIndex];
+        std::vector<Point> fiber;
+        try {
+            for (;;) {
+                size_t first = nextSeed.fetch_add(batchSize, std::memory_order_relaxed);
+                if (first >= seedCount) {
+                    break;
+                }
+                size_t last = std::min(first + batchSize, seedCount);
+                for (size_t i = first; i < last; i++) {
+                    fiber.clear();
+                    trace(seeds[i], fiber);
+                    buffer.add(i, fiber.data(), fiber.size());
+                }
+            }
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(failureMutex);
+            if (!failure) {
+                failure = std::current_exception();
+            }
+            nextSeed.store(seedCount);
+        }
+    };
+
+    if (threadCount == 1) {
+        worker(0);
+    } else {
+        runOnAllWorkers(worker);
+    }
+
+    if (failure) {
+        std::rethrow_exception(failure);
+    }
+
+    // back into seed order
+    mergeTractogramChunks(buffers, seedCount, fibers);
+}
+
+#endif // PARALLEL_SEED_TRACKER_H
\ No newline at end of file
@@ -0,0 +1,71 @@
+#include "ProgressiveFiberView.h"
+#include "FiberPolyData.h"
+#include <vtkActor.h>
+#include <vtkProperty.h>
+#include <utility>
+
+ProgressiveFiberView::ProgressiveFiberView(const char* name)
+    : minInterval(std::chrono::seconds(1)), windowName(name) {
+}
+
+ProgressiveFiberView::~ProgressiveFiberView() {
+    close();
+}
+
+void ProgressiveFiberView::setMaxRedrawRate(double redrawsPerSecond) {
+    if (redrawsPerSecond <= 0) {
+        minInterval = std::chrono::steady_clock::duration::max();
+        return;
+    }
+    minInterval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(1.0 / redrawsPerSecond));
+}
+
+bool ProgressiveFiberView::redrawDue() const {
+    if (!renderWindow) {
+        return minInterval != std::chrono::steady_clock::duration::max();
+    }
+    return std::chrono::steady_clock::now() - lastRedraw >= minInterval;
+}
+
+void ProgressiveFiberView::createWindow() {
+    mapper = vtkSmartPointer<vtkPolyDataMapper>::New();
+
+    auto actor = vtkSmartPointer<vtkActor>::New();
+    actor->SetMapper(mapper);
+    actor->GetProperty()->SetLineWidth(2.0);
+
+    renderer = vtkSmartPointer<vtkRenderer>::New();
+    renderer->AddActor(actor);
+    renderer->SetBackground(0.1, 0.1, 0.1);
+
+    renderWindow = vtkSmartPointer<vtkRenderWindow>::New();
+    renderWindow->AddRenderer(renderer);
+    renderWindow->SetSize(800, 800);
+    renderWindow->SetWindowName(windowName);
+}
+
+void ProgressiveFiberView::redraw(const Tractogram& fibers) {
+    if (!renderWindow) {
+        createWindow();
+    }
+
+    // the old snapshot is released only once the mapper has moved off it
+    Tractogram copy(fibers);
+    auto polyData = buildFiberPolyData(copy);
+    mapper->SetInputData(polyData);
+    snapshot = std::move(copy);
+    renderer->ResetCamera();
+    renderWindow->Render();
+    lastRedraw = std::chrono::steady_clock::now();
+}
+
+void ProgressiveFiberView::close() {
+    if (renderWindow) {
+        renderWindow->Finalize();
+        renderWindow = nullptr;
+        renderer = nullptr;
+        mapper = nullptr;
+        snapshot = Tractogram();
+    }
+}
\ No newline at end of file
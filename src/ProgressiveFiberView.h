@@ -0,0 +1,47 @@
+#ifndef PROGRESSIVE_FIBER_VIEW_H
+#define PROGRESSIVE_FIBER_VIEW_H
+
+#include <vtkSmartPointer.h>
+#include <vtkPolyData.h>
+#include <vtkPolyDataMapper.h>
+#include <vtkRenderer.h>
+#include <vtkRenderWindow.h>
+#include "Tractogram.h"
+#include <chrono>
+
+// How a tracker shows its fibers.
+// Headless: trace only, visualize() does nothing (batch/server runs).
+// Final: trace to completion, then draw once in visualize().
+// Progressive: like Final, but also redraw a snapshot while tracing, at most N times per second.
+enum class FiberDisplayMode {
+    Headless,
+    Final,
+    Progressive
+};
+
+// Persistent window used for progressive redraws while a tracker is still running.
+// The window and pipeline are created once; each redraw only swaps in new geometry.
+class ProgressiveFiberView {
+private:
+    vtkSmartPointer<vtkPolyDataMapper> mapper;
+    vtkSmartPointer<vtkRenderer> renderer;
+    vtkSmartPointer<vtkRenderWindow> renderWindow;
+    Tractogram snapshot;    // what the mapper draws
+    std::chrono::steady_clock::duration minInterval;
+    std::chrono::steady_clock::time_point lastRedraw;
+    const char* windowName;
+
+    void createWindow();
+
+public:
+    explicit ProgressiveFiberView(const char* windowName);
+    ~ProgressiveFiberView();
+    void setMaxRedrawRate(double redrawsPerSecond);
+    bool redrawDue() const;
+    // Draws the streamlines traced so far. They are copied into the view's own snapshot,
+    // so fibers may grow (and reallocate) while the window still shows them.
+    void redraw(const Tractogram& fibers);
+    void close();
+};
+
+#endif // PROGRESSIVE_FIBER_VIEW_H
\ No newline at end of file
@@ -0,0 +1,193 @@
+#include "RunMetrics.h"
+#include <functional>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <sys/resource.h>
+#include <time.h>
+
+namespace {
+
+const size_t SHARDS = 64;
+const size_t COUNTERS = static_cast<size_t>(MetricCounter::Count);
+const size_t GAUGES = static_cast<size_t>(MetricGauge::Count);
+
+struct alignas(64) CounterShard {
+    std::atomic<uint64_t> values[COUNTERS];
+};
+
+CounterShard shards[SHARDS];
+std::atomic<uint64_t> gauges[GAUGES];
+
+struct StageStats {
+    uint64_t calls = 0;
+    double wallSeconds = 0.0;
+    double cpuSeconds = 0.0;
+};
+
+std::mutex stageMutex;
+std::map<std::string, StageStats> stages;
+
+const char* const COUNTER_NAMES[COUNTERS] = {
+    "voxels_processed", "steps_integrated", "streamlines",
+    "terminations_bounds", "terminations_mask", "terminations_fa",
+    "terminations_curvature", "terminations_max_length",
+    "bytes_read", "bytes_written"};
+const char* const GAUGE_NAMES[GAUGES] = {"queue_high_water"};
+
+CounterShard& threadShard() {
+    thread_local CounterShard* shard = &shards[std::hash<std::thread::id>()(std::this_thread::get_id()) % SHARDS];
+    return *shard;
+}
+
+double processCPUSeconds() {
+    timespec now;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+bool isPrometheusPath(const std::string& path) {
+    for (const char* extension : {".prom", ".txt"}) {
+        std::string suffix(extension);
+        if (path.size() >= suffix.size() && path.compare(path.size() - suffix.size(), suffix.size(), suffix) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+}
+
+std::atomic<bool> RunMetrics::active(false);
+
+void RunMetrics::enable(bool on) {
+    active.store(on, std::memory_order_relaxed);
+}
+
+void RunMetrics::addSlow(MetricCounter counter, uint64_t value) {
+    threadShard().values[static_cast<size_t>(counter)].fetch_add(value, std::memory_order_relaxed);
+}
+
+void RunMetrics::observeMaxSlow(MetricGauge gauge, uint64_t value) {
+    std::atomic<uint64_t>& slot = gauges[static_cast<size_t>(gauge)];
+    uint64_t current = slot.load(std::memory_order_relaxed);
+    while (value > current && !slot.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+}
+
+void RunMetrics::recordStage(const std::string& stage, double wallSeconds, double cpuSeconds) {
+    if (!enabled()) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(stageMutex);
+    StageStats& stats = stages[stage];
+    stats.calls++;
+    stats.wallSeconds += wallSeconds;
+    stats.cpuSeconds += cpuSeconds;
+}
+
+uint64_t RunMetrics::counter(MetricCounter counter) {
+    uint64_t sum = 0;
+    for (const auto& shard : shards) {
+        sum += shard.values[static_cast<size_t>(counter)].load(std::memory_order_relaxed);
+    }
+    return sum;
+}
+
+uint64_t RunMetrics::gauge(MetricGauge gauge) {
+    return gauges[static_cast<size_t>(gauge)].load(std::memory_order_relaxed);
+}
+
+uint64_t RunMetrics::peakRSSBytes() {
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+    return static_cast<uint64_t>(usage.ru_maxrss) * 1024;   // kilobytes on Linux
+}
+
+void RunMetrics::write(const std::string& path) {
+    std::ofstream out(path, std::ios::trunc);
+    if (!out) {
+        throw std::runtime_error("Cannot write " + path);
+    }
+
+    std::map<std::string, StageStats> stageCopy;
+    {
+        std::lock_guard<std::mutex> lock(stageMutex);
+        stageCopy = stages;
+    }
+
+    if (isPrometheusPath(path)) {
+        for (size_t i = 0; i < COUNTERS; i++) {
+            out << "# TYPE dti_" << COUNTER_NAMES[i] << "_total counter\n";
+            out << "dti_" << COUNTER_NAMES[i] << "_total " << counter(static_cast<MetricCounter>(i)) << "\n";
+        }
+        for (size_t i = 0; i < GAUGES; i++) {
+            out << "# TYPE dti_" << GAUGE_NAMES[i] << " gauge\n";
+            out << "dti_" << GAUGE_NAMES[i] << " " << gauge(static_cast<MetricGauge>(i)) << "\n";
+        }
+        out << "# TYPE dti_peak_rss_bytes gauge\n";
+        out << "dti_peak_rss_bytes " << peakRSSBytes() << "\n";
+        out << "# TYPE dti_stage_calls_total counter\n";
+        for (const auto& stage : stageCopy) {
+            out << "dti_stage_calls_total{stage=\"" << stage.first << "\"} " << stage.second.calls << "\n";
+        }
+        out << "# TYPE dti_stage_wall_seconds_total counter\n";
+        for (const auto& stage : stageCopy) {
+            out << "dti_stage_wall_seconds_total{stage=\"" << stage.first << "\"} " << stage.second.wallSeconds << "\n";
+        }
+        out << "# TYPE dti_stage_cpu_seconds_total counter\n";
+        for (const auto& stage : stageCopy) {
+            out << "dti_stage_cpu_seconds_total{stage=\"" << stage.first << "\"} " << stage.second.cpuSeconds << "\n";
+        }
+        return;
+    }
+
+    out << "{\n  \"counters\": {";
+    for (size_t i = 0; i < COUNTERS; i++) {
+        out << (i ? ", " : "") << "\"" << COUNTER_NAMES[i] << "\": " << counter(static_cast<MetricCounter>(i));
+    }
+    out << "},\n  \"gauges\": {";
+    for (size_t i = 0; i < GAUGES; i++) {
+        out << (i ? ", " : "") << "\"" << GAUGE_NAMES[i] << "\": " << gauge(static_cast<MetricGauge>(i));
+    }
+    out << ", \"peak_rss_bytes\": " << peakRSSBytes() << "},\n  \"stages\": {";
+    bool first = true;
+    for (const auto& stage : stageCopy) {
+        out << (first ? "\n" : ",\n") << "    \"" << stage.first << "\": {\"calls\": " << stage.second.calls
+            << ", \"wall_seconds\": " << stage.second.wallSeconds << ", \"cpu_seconds\": " << stage.second.cpuSeconds << "}";
+        first = false;
+    }
+    out << (first ? "" : "\n  ") << "}\n}\n";
+}
+
+void RunMetrics::reset() {
+    for (auto& shard : shards) {
+        for (auto& value : shard.values) {
+            value.store(0, std::memory_order_relaxed);
+        }
+    }
+    for (auto& value : gauges) {
+        value.store(0, std::memory_order_relaxed);
+    }
+    std::lock_guard<std::mutex> lock(stageMutex);
+    stages.clear();
+}
+
+StageTimer::StageTimer(const char* stageName)
+    : stage(stageName), running(RunMetrics::enabled()), cpuStart(0.0) {
+    if (running) {
+        wallStart = std::chrono::steady_clock::now();
+        cpuStart = processCPUSeconds();
+    }
+}
+
+StageTimer::~StageTimer() {
+    if (running) {
+        double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+        RunMetrics::recordStage(stage, wall, processCPUSeconds() - cpuStart);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,83 @@
+#ifndef RUN_METRICS_H
+#define RUN_METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// Process-wide counters, gauges and stage timers for one run.
+// Disabled by default: every recording call starts with one relaxed load of a
+// flag and returns, so instrumented hot paths cost nothing measurable.
+// When enabled, counters are sharded per thread on separate cache lines, so
+// tracker threads never contend; shards are summed only when exporting.
+// Hot loops should accumulate locally and add once per streamline/slab.
+enum class MetricCounter {
+    VoxelsProcessed,
+    StepsIntegrated,
+    Streamlines,
+    TerminationBounds,
+    TerminationMask,
+    TerminationFA,
+    TerminationCurvature,
+    TerminationLength,
+    BytesRead,
+    BytesWritten,
+    Count
+};
+
+enum class MetricGauge {
+    QueueHighWater,     // max batches waiting between tracker workers and the writer
+    Count
+};
+
+class RunMetrics {
+private:
+    static std::atomic<bool> active;
+
+    static void addSlow(MetricCounter counter, uint64_t value);
+    static void observeMaxSlow(MetricGauge gauge, uint64_t value);
+
+public:
+    static void enable(bool on = true);
+    static bool enabled() { return active.load(std::memory_order_relaxed); }
+
+    static void add(MetricCounter counter, uint64_t value = 1) {
+        if (enabled()) {
+            addSlow(counter, value);
+        }
+    }
+    static void observeMax(MetricGauge gauge, uint64_t value) {
+        if (enabled()) {
+            observeMaxSlow(gauge, value);
+        }
+    }
+    static void recordStage(const std::string& stage, double wallSeconds, double cpuSeconds);
+
+    static uint64_t counter(MetricCounter counter);
+    static uint64_t gauge(MetricGauge gauge);
+    // peak resident set size of the process so far
+    static uint64_t peakRSSBytes();
+
+    // Prometheus text format for .prom/.txt paths, JSON otherwise.
+    static void write(const std::string& path);
+    static void reset();
+};
+
+// Times one stage from construction to destruction: wall clock and process CPU
+// time (all threads), accumulated per stage name.
+class StageTimer {
+private:
+    const char* stage;
+    bool running;
+    std::chrono::steady_clock::time_point wallStart;
+    double cpuStart;
+
+public:
+    explicit StageTimer(const char* stageName);
+    ~StageTimer();
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+};
+
+#endif // RUN_METRICS_H
\ No newline at end of file
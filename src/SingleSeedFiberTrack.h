@@ -3,26 +3,26 @@
 
 #include <vtkSmartPointer.h>
 #include <vtkImageData.h>
+#include "VolumeStore.h"
+#include "StreamlineIntegrator.h"
+#include "ProgressiveFiberView.h"
+#include "Tractogram.h"
 #include <array>
 #include <vector>
 
 class SingleSeedFiberTrack {
 private:
-    std::vector<float> vectorData;
-    vtkSmartPointer<vtkImageData> faImage;
-    std::vector<std::array<double, 3>> fiberPoints;
-    double alpha;
-    double stepSize;
-    const int dimensions[3] = {144, 144, 85};
-    const int MAX_STEPS = 200000;
-
-    bool isInside(const std::array<double, 3>& point);
-    double getFAValue(const std::array<double, 3>& point);
-    std::array<double, 3> getVector(const std::array<double, 3>& point);
+    std::shared_ptr<const DirectionFAVolume> volume;
+    std::shared_ptr<const ActiveVoxelMask> activeMask;
+    Tractogram fiber;
+    StreamlineIntegrator integrator;
+    FiberDisplayMode displayMode;
 
 public:
     SingleSeedFiberTrack(const char* vectorBinFile, const char* faFile);
     void setParameters(double newAlpha, double newStepSize);
+    void setStreamlineParameters(const StreamlineParameters& params);
+    void setDisplayMode(FiberDisplayMode mode, double maxRedrawsPerSecond = 1.0);
     void traceFiber(const std::array<double, 3>& seed);
     void visualize();
 };
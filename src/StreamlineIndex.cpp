@@ -0,0 +1,632 @@
+#include "StreamlineIndex.h"
+#include <algorithm>
+#include <atomic>
+#include <bitset>
+#include <cmath>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+namespace {
+
+const char INDEX_MAGIC[8] = {'D', 'T', 'I', 'S', 'I', 'D', 'X', '\0'};
+const uint64_t INDEX_VERSION = 1;
+const char INDEX_EXTENSION[] = ".sidx";
+
+// postings buffered before they are sorted into a block (64 MB)
+const size_t BLOCK_POSTINGS = size_t(1) << 23;
+// streamlines a worker takes at a time when an add() is split across threads
+const size_t STREAMLINES_PER_CHUNK = 1024;
+
+struct IndexFileHeader {
+    char magic[8];
+    uint64_t version;
+    uint64_t dimensions[3];
+    uint64_t streamlineCount;
+    uint64_t voxelCounts[2];    // passing, endpoints
+    uint64_t byteCounts[2];
+};
+
+inline void putVarint(uint64_t value, std::vector<uint8_t>& bytes) {
+    while (value >= 0x80) {
+        bytes.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    bytes.push_back(static_cast<uint8_t>(value));
+}
+
+// One LEB128 varint; false if it runs past end or does not fit 64 bits.
+inline bool getVarint(const uint8_t*& cursor, const uint8_t* end, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; cursor < end && shift < 64; shift += 7) {
+        const uint8_t byte = *cursor++;
+        if (shift == 63 && byte > 1) {
+            return false;
+        }
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if (byte < 0x80) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Calls visit(id) for every id of one encoded list: ascending, the first delta coded from 0.
+// Lists come from the builder or a validated file (see readLists), so a bad varint just ends the list.
+template <typename Visit>
+inline void decodePostings(const uint8_t* cursor, const uint8_t* end, Visit visit) {
+    uint64_t id = 0;
+    uint64_t delta;
+    while (getVarint(cursor, end, delta)) {
+        id += delta;
+        visit(id);
+    }
+}
+
+// voxel i is [i, i + 1) on each axis
+inline bool voxelIndex(const int64_t voxel[3], const uint64_t dims[3], uint64_t& index) {
+    if (voxel[0] < 0 || voxel[1] < 0 || voxel[2] < 0 || voxel[0] >= static_cast<int64_t>(dims[0]) ||
+        voxel[1] >= static_cast<int64_t>(dims[1]) || voxel[2] >= static_cast<int64_t>(dims[2])) {
+        return false;
+    }
+    index = static_cast<uint64_t>(voxel[0]) +
+            dims[0] * (static_cast<uint64_t>(voxel[1]) + dims[1] * static_cast<uint64_t>(voxel[2]));
+    return true;
+}
+
+inline bool pointVoxel(const Tractogram::Point& point, const uint64_t dims[3], uint64_t& index) {
+    const int64_t voxel[3] = {static_cast<int64_t>(std::floor(point[0])), static_cast<int64_t>(std::floor(point[1])),
+                              static_cast<int64_t>(std::floor(point[2]))};
+    return voxelIndex(voxel, dims, index);
+}
+
+// Appends every voxel the segment a -> b passes through (Amanatides & Woo),
+// skipping voxels outside the volume and repeats of the last voxel appended.
+void walkSegment(const Tractogram::Point& a, const Tractogram::Point& b, const uint64_t dims[3],
+                 std::vector<uint64_t>& voxels) {
+    int64_t voxel[3];
+    int64_t last[3];
+    int64_t step[3];
+    double next[3];     // segment parameter of the next boundary crossing on each axis
+    double delta[3];
+    uint64_t remaining = 0;
+    for (int k = 0; k < 3; k++) {
+        voxel[k] = static_cast<int64_t>(std::floor(a[k]));
+        last[k] = static_cast<int64_t>(std::floor(b[k]));
+        const double d = static_cast<double>(b[k]) - a[k];
+        if (d > 0.0) {
+            step[k] = 1;
+            delta[k] = 1.0 / d;
+            next[k] = (voxel[k] + 1 - static_cast<double>(a[k])) * delta[k];
+        } else if (d < 0.0) {
+            step[k] = -1;
+            delta[k] = -1.0 / d;
+            next[k] = (a[k] - static_cast<double>(voxel[k])) * delta[k];
+        } else {
+            step[k] = 0;
+            delta[k] = std::numeric_limits<double>::infinity();
+            next[k] = delta[k];
+        }
+        remaining += static_cast<uint64_t>(std::abs(last[k] - voxel[k]));
+    }
+
+    for (;;) {
+        uint64_t index;
+        if (voxelIndex(voxel, dims, index) && (voxels.empty() || voxels.back() != index)) {
+            voxels.push_back(index);
+        }
+        if (remaining-- == 0) {
+            return;
+        }
+        // only axes still short of the end voxel, so rounding can never overshoot it
+        int axis = -1;
+        for (int k = 0; k < 3; k++) {
+            if (voxel[k] != last[k] && (axis < 0 || next[k] < next[axis])) {
+                axis = k;
+            }
+        }
+        voxel[axis] += step[axis];
+        next[axis] += delta[axis];
+    }
+}
+
+// non-empty streamlines among first .. last - 1
+size_t countStreamlines(const Tractogram& fibers, size_t first, size_t last) {
+    size_t count = 0;
+    for (size_t i = first; i < last; i++) {
+        count += fibers.streamlineSize(i) != 0;
+    }
+    return count;
+}
+
+// Appends the postings of streamlines first .. last - 1 of fibers; the non-empty ones are numbered from id.
+void streamlinePostings(const Tractogram& fibers, size_t first, size_t last, uint64_t id, const uint64_t dims[3],
+                        std::vector<uint64_t> postings[2], std::vector<uint64_t>& voxels) {
+    for (size_t i = first; i < last; i++) {
+        const Tractogram::Point* points = fibers.streamline(i);
+        const size_t count = fibers.streamlineSize(i);
+        if (count == 0) {
+            continue;
+        }
+
+        voxels.clear();
+        walkSegment(points[0], points[0], dims, voxels);
+        for (size_t p = 1; p < count; p++) {
+            walkSegment(points[p - 1], points[p], dims, voxels);
+        }
+        std::sort(voxels.begin(), voxels.end());
+        voxels.erase(std::unique(voxels.begin(), voxels.end()), voxels.end());
+        for (uint64_t voxel : voxels) {
+            postings[0].push_back(voxel << 32 | id);
+        }
+
+        uint64_t start = 0;
+        uint64_t end = 0;
+        const bool startInside = pointVoxel(points[0], dims, start);
+        const bool endInside = pointVoxel(points[count - 1], dims, end);
+        if (startInside) {
+            postings[1].push_back(start << 32 | id);
+        }
+        if (endInside && !(startInside && end == start)) {
+            postings[1].push_back(end << 32 | id);
+        }
+        id++;
+    }
+}
+
+// One encoded block from (voxel << 32 | id) entries in increasing id order.
+// A stable counting sort by voxel keeps each voxel's ids ascending.
+StreamlineIndex::PostingLists encodeBlock(const std::vector<uint64_t>& entries, uint64_t voxelCount) {
+    std::vector<uint32_t> counts(voxelCount + 1, 0);
+    for (uint64_t entry : entries) {
+        counts[(entry >> 32) + 1]++;
+    }
+    for (uint64_t v = 0; v < voxelCount; v++) {
+        counts[v + 1] += counts[v];
+    }
+    std::vector<uint32_t> ids(entries.size());
+    {
+        std::vector<uint32_t> cursor(counts.begin(), counts.end() - 1);
+        for (uint64_t entry : entries) {
+            ids[cursor[entry >> 32]++] = static_cast<uint32_t>(entry);
+        }
+    }
+
+    StreamlineIndex::PostingLists lists;
+    lists.bytes.reserve(entries.size() * 2);
+    for (uint64_t v = 0; v < voxelCount; v++) {
+        if (counts[v] == counts[v + 1]) {
+            continue;
+        }
+        lists.voxels.push_back(v);
+        lists.starts.push_back(lists.bytes.size());
+        uint64_t previous = 0;
+        for (uint32_t i = counts[v]; i < counts[v + 1]; i++) {
+            putVarint(ids[i] - previous, lists.bytes);
+            previous = ids[i];
+        }
+    }
+    lists.starts.push_back(lists.bytes.size());
+    return lists;
+}
+
+// Blocks hold consecutive id ranges, so a voxel's lists concatenate in block order.
+StreamlineIndex::PostingLists mergeBlocks(std::vector<StreamlineIndex::PostingLists>& blocks) {
+    if (blocks.size() == 1) {
+        return std::move(blocks.front());
+    }
+
+    StreamlineIndex::PostingLists merged;
+    std::vector<size_t> position(blocks.size(), 0);
+    for (;;) {
+        uint64_t voxel = std::numeric_limits<uint64_t>::max();
+        for (size_t b = 0; b < blocks.size(); b++) {
+            if (position[b] < blocks[b].voxels.size()) {
+                voxel = std::min(voxel, blocks[b].voxels[position[b]]);
+            }
+        }
+        if (voxel == std::numeric_limits<uint64_t>::max()) {
+            break;
+        }
+
+        merged.voxels.push_back(voxel);
+        merged.starts.push_back(merged.bytes.size());
+        uint64_t previous = 0;
+        for (size_t b = 0; b < blocks.size(); b++) {
+            const StreamlineIndex::PostingLists& block = blocks[b];
+            size_t& i = position[b];
+            if (i == block.voxels.size() || block.voxels[i] != voxel) {
+                continue;
+            }
+            decodePostings(block.bytes.data() + block.starts[i], block.bytes.data() + block.starts[i + 1],
+                           [&](uint64_t id) {
+                               putVarint(id - previous, merged.bytes);
+                               previous = id;
+                           });
+            i++;
+        }
+    }
+    merged.starts.push_back(merged.bytes.size());
+    blocks.clear();
+    return merged;
+}
+
+void writeLists(std::ofstream& out, const StreamlineIndex::PostingLists& lists) {
+    out.write(reinterpret_cast<const char*>(lists.voxels.data()), lists.voxels.size() * sizeof(uint64_t));
+    out.write(reinterpret_cast<const char*>(lists.starts.data()), lists.starts.size() * sizeof(uint64_t));
+    out.write(reinterpret_cast<const char*>(lists.bytes.data()), lists.bytes.size());
+}
+
+// Reads one set of lists from the next bytes of the file; remaining counts those bytes down.
+// select() writes every decoded id into a bitset, so the whole file is checked here: sizes
+// within the file, voxels ascending inside the volume, every list's ids strictly ascending
+// below streamlineCount.
+bool readLists(std::ifstream& in, uint64_t voxelCount, uint64_t byteCount, uint64_t volumeVoxels,
+               uint64_t streamlineCount, uint64_t& remaining, StreamlineIndex::PostingLists& lists) {
+    const uint64_t entryBytes = 2 * sizeof(uint64_t);
+    if (remaining < sizeof(uint64_t) || voxelCount > (remaining - sizeof(uint64_t)) / entryBytes ||
+        byteCount > remaining - sizeof(uint64_t) - voxelCount * entryBytes) {
+        return false;
+    }
+    remaining -= sizeof(uint64_t) + voxelCount * entryBytes + byteCount;
+
+    lists.voxels.resize(voxelCount);
+    lists.starts.resize(voxelCount + 1);
+    lists.bytes.resize(byteCount);
+    in.read(reinterpret_cast<char*>(lists.voxels.data()), voxelCount * sizeof(uint64_t));
+    in.read(reinterpret_cast<char*>(lists.starts.data()), (voxelCount + 1) * sizeof(uint64_t));
+    in.read(reinterpret_cast<char*>(lists.bytes.data()), byteCount);
+    if (!in || lists.starts.front() != 0 || lists.starts.back() != byteCount ||
+        !std::is_sorted(lists.starts.begin(), lists.starts.end()) ||
+        std::adjacent_find(lists.voxels.begin(), lists.voxels.end(), std::greater_equal<uint64_t>()) !=
+            lists.voxels.end() ||
+        (!lists.voxels.empty() && lists.voxels.back() >= volumeVoxels)) {
+        return false;
+    }
+
+    for (uint64_t i = 0; i < voxelCount; i++) {
+        const uint8_t* cursor = lists.bytes.data() + lists.starts[i];
+        const uint8_t* end = lists.bytes.data() + lists.starts[i + 1];
+        // streamlineCount - previous id: the next delta must stay below it; the first id may be 0
+        uint64_t idsLeft = streamlineCount;
+        uint64_t delta;
+        for (bool first = true; cursor < end; first = false) {
+            if (!getVarint(cursor, end, delta) || (!first && delta == 0) || delta >= idsLeft) {
+                return false;
+            }
+            idsLeft -= delta;
+        }
+    }
+    return true;
+}
+
+}
+
+StreamlineSelection::StreamlineSelection(size_t streamlineCount, bool all)
+    : words((streamlineCount + 63) / 64, all ? ~uint64_t(0) : 0), streamlines(streamlineCount) {
+    // bits past the last streamline stay clear, so count() needs no mask
+    if (all && (streamlineCount & 63) != 0) {
+        words.back() = (uint64_t(1) << (streamlineCount & 63)) - 1;
+    }
+}
+
+size_t StreamlineSelection::count() const {
+    size_t total = 0;
+    for (uint64_t word : words) {
+        total += std::bitset<64>(word).count();
+    }
+    return total;
+}
+
+std::vector<uint32_t> StreamlineSelection::ids() const {
+    std::vector<uint32_t> selected;
+    for (size_t w = 0; w < words.size(); w++) {
+        for (uint64_t word = words[w]; word != 0; word &= word - 1) {
+            selected.push_back(static_cast<uint32_t>(w * 64 + std::bitset<64>((word & -word) - 1).count()));
+        }
+    }
+    return selected;
+}
+
+StreamlineSelection& StreamlineSelection::operator&=(const StreamlineSelection& other) {
+    for (size_t w = 0; w < words.size(); w++) {
+        words[w] &= w < other.words.size() ? other.words[w] : 0;
+    }
+    return *this;
+}
+
+StreamlineSelection& StreamlineSelection::operator|=(const StreamlineSelection& other) {
+    for (size_t w = 0; w < words.size() && w < other.words.size(); w++) {
+        words[w] |= other.words[w];
+    }
+    return *this;
+}
+
+StreamlineSelection& StreamlineSelection::subtract(const StreamlineSelection& other) {
+    for (size_t w = 0; w < words.size() && w < other.words.size(); w++) {
+        words[w] &= ~other.words[w];
+    }
+    return *this;
+}
+
+StreamlineIndex::StreamlineIndex() : dims{0, 0, 0}, streamlines(0) {
+    passing.starts.assign(1, 0);
+    endpoints.starts.assign(1, 0);
+}
+
+StreamlineIndex StreamlineIndex::build(const Tractogram& fibers, const int dimensions[3], unsigned int numThreads) {
+    StreamlineIndexBuilder builder(dimensions, numThreads);
+    builder.add(fibers);
+    return builder.finish();
+}
+
+uint64_t StreamlineIndex::postingCount() const {
+    uint64_t total = 0;
+    for (const PostingLists* lists : {&passing, &endpoints}) {
+        // every id ends in exactly one byte below 0x80
+        for (uint8_t byte : lists->bytes) {
+            total += byte < 0x80;
+        }
+    }
+    return total;
+}
+
+void StreamlineIndex::collect(const PostingLists& lists, uint64_t first, uint64_t last,
+                              StreamlineSelection& selection) const {
+    auto begin = std::lower_bound(lists.voxels.begin(), lists.voxels.end(), first);
+    for (auto it = begin; it != lists.voxels.end() && *it < last; ++it) {
+        const size_t i = static_cast<size_t>(it - lists.voxels.begin());
+        decodePostings(lists.bytes.data() + lists.starts[i], lists.bytes.data() + lists.starts[i + 1],
+                       [&](uint64_t id) { selection.set(static_cast<size_t>(id)); });
+    }
+}
+
+StreamlineSelection StreamlineIndex::passingThrough(const std::vector<uint64_t>& roi) const {
+    StreamlineSelection selection(streamlines);
+    for (uint64_t voxel : roi) {
+        collect(passing, voxel, voxel + 1, selection);
+    }
+    return selection;
+}
+
+StreamlineSelection StreamlineIndex::passingThrough(const ActiveVoxelMask& roi) const {
+    StreamlineSelection selection(streamlines);
+    for (const auto& run : roi.runs()) {
+        collect(passing, run.start, run.start + run.length, selection);
+    }
+    return selection;
+}
+
+StreamlineSelection StreamlineIndex::endingIn(const std::vector<uint64_t>& roi) const {
+    StreamlineSelection selection(streamlines);
+    for (uint64_t voxel : roi) {
+        collect(endpoints, voxel, voxel + 1, selection);
+    }
+    return selection;
+}
+
+StreamlineSelection StreamlineIndex::select(const RoiQuery& query) const {
+    StreamlineSelection selection(streamlines, true);
+    for (const auto& roi : query.include) {
+        selection &= passingThrough(roi);
+    }
+    for (const auto& roi : query.end) {
+        selection &= endingIn(roi);
+    }
+    for (const auto& roi : query.exclude) {
+        selection.subtract(passingThrough(roi));
+    }
+    return selection;
+}
+
+void StreamlineIndex::save(const std::string& path) const {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        throw std::runtime_error("Cannot write " + path);
+    }
+
+    IndexFileHeader header;
+    std::memcpy(header.magic, INDEX_MAGIC, sizeof(header.magic));
+    header.version = INDEX_VERSION;
+    for (int i = 0; i < 3; i++) {
+        header.dimensions[i] = dims[i];
+    }
+    header.streamlineCount = streamlines;
+    header.voxelCounts[0] = passing.voxels.size();
+    header.voxelCounts[1] = endpoints.voxels.size();
+    header.byteCounts[0] = passing.bytes.size();
+    header.byteCounts[1] = endpoints.bytes.size();
+
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    writeLists(out, passing);
+    writeLists(out, endpoints);
+    if (!out) {
+        throw std::runtime_error("Failed writing " + path);
+    }
+}
+
+StreamlineIndex StreamlineIndex::load(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        throw std::runtime_error("Cannot open " + path);
+    }
+
+    IndexFileHeader header;
+    in.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!in || std::memcmp(header.magic, INDEX_MAGIC, sizeof(header.magic)) != 0 || header.version != INDEX_VERSION) {
+        throw std::runtime_error("Not a streamline index: " + path);
+    }
+
+    // the builder's limits; bounds what a selection allocates
+    uint64_t volumeVoxels = 1;
+    for (int i = 0; i < 3; i++) {
+        if (header.dimensions[i] > (uint64_t(1) << 32)) {
+            throw std::runtime_error("Corrupt streamline index: " + path);
+        }
+        volumeVoxels *= header.dimensions[i];
+        volumeVoxels = std::min(volumeVoxels, (uint64_t(1) << 32) + 1);
+    }
+    if (volumeVoxels > (uint64_t(1) << 32) || header.streamlineCount > (uint64_t(1) << 32)) {
+        throw std::runtime_error("Corrupt streamline index: " + path);
+    }
+
+    in.seekg(0, std::ios::end);
+    uint64_t remaining = static_cast<uint64_t>(in.tellg()) - sizeof(header);
+    in.seekg(sizeof(header), std::ios::beg);
+
+    StreamlineIndex index;
+    for (int i = 0; i < 3; i++) {
+        index.dims[i] = header.dimensions[i];
+    }
+    index.streamlines = header.streamlineCount;
+    if (!in ||
+        !readLists(in, header.voxelCounts[0], header.byteCounts[0], volumeVoxels, header.streamlineCount, remaining,
+                   index.passing) ||
+        !readLists(in, header.voxelCounts[1], header.byteCounts[1], volumeVoxels, header.streamlineCount, remaining,
+                   index.endpoints) ||
+        remaining != 0) {
+        throw std::runtime_error("Truncated or corrupt streamline index: " + path);
+    }
+    return index;
+}
+
+StreamlineIndexBuilder::StreamlineIndexBuilder(const int dimensions[3], unsigned int threads)
+    : dims{static_cast<uint64_t>(dimensions[0]), static_cast<uint64_t>(dimensions[1]), static_cast<uint64_t>(dimensions[2])},
+      numThreads(threads > 0 ? threads : std::max(1u, std::thread::hardware_concurrency())), streamlines(0) {
+    if (dims[0] * dims[1] * dims[2] > (uint64_t(1) << 32)) {
+        throw std::runtime_error("Streamline index: volume has more than 2^32 voxels");
+    }
+}
+
+void StreamlineIndexBuilder::add(const Tractogram& fibers) {
+    const size_t chunkCount = (fibers.size() + STREAMLINES_PER_CHUNK - 1) / STREAMLINES_PER_CHUNK;
+    // first id of every chunk
+    std::vector<uint64_t> chunkIds(chunkCount + 1, streamlines);
+    for (size_t chunk = 0; chunk < chunkCount; chunk++) {
+        const size_t first = chunk * STREAMLINES_PER_CHUNK;
+        chunkIds[chunk + 1] = chunkIds[chunk] + countStreamlines(fibers, first, std::min(first + STREAMLINES_PER_CHUNK, fibers.size()));
+    }
+    if (chunkIds.back() > (uint64_t(1) << 32)) {
+        throw std::runtime_error("Streamline index: more than 2^32 streamlines");
+    }
+
+    const unsigned int threadCount = static_cast<unsigned int>(std::max<size_t>(1, std::min<size_t>(numThreads, chunkCount)));
+    if (threadCount == 1) {
+        std::vector<uint64_t> voxels;
+        for (size_t chunk = 0; chunk < chunkCount; chunk++) {
+            const size_t first = chunk * STREAMLINES_PER_CHUNK;
+            const size_t last = std::min(first + STREAMLINES_PER_CHUNK, fibers.size());
+            streamlinePostings(fibers, first, last, chunkIds[chunk], dims, pending, voxels);
+            for (int list = 0; list < 2; list++) {
+                if (pending[list].size() >= BLOCK_POSTINGS) {
+                    flush(list);
+                }
+            }
+        }
+        streamlines = chunkIds.back();
+        return;
+    }
+
+    // Rounds of a few chunks per thread bound the unsorted postings held at once;
+    // chunk results are appended in chunk order, so ids stay in order.
+    const size_t roundChunks = static_cast<size_t>(threadCount) * 8;
+    std::vector<std::vector<uint64_t>> chunkPostings(roundChunks * 2);
+    for (size_t firstChunk = 0; firstChunk < chunkCount; firstChunk += roundChunks) {
+        const size_t lastChunk = std::min(firstChunk + roundChunks, chunkCount);
+        std::atomic<size_t> nextChunk(firstChunk);
+        std::exception_ptr failure;
+        std::mutex failureMutex;
+
+        auto worker = [&]() {
+            std::vector<uint64_t> voxels;
+            try {
+                for (size_t chunk = nextChunk++; chunk < lastChunk; chunk = nextChunk++) {
+                    std::vector<uint64_t>* out = &chunkPostings[(chunk - firstChunk) * 2];
+                    out[0].clear();
+                    out[1].clear();
+                    const size_t first = chunk * STREAMLINES_PER_CHUNK;
+                    const size_t last = std::min(first + STREAMLINES_PER_CHUNK, fibers.size());
+                    streamlinePostings(fibers, first, last, chunkIds[chunk], dims, out, voxels);
+                }
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(failureMutex);
+                if (!failure) {
+                    failure = std::current_exception();
+                }
+                nextChunk = lastChunk;
+            }
+        };
+
+        std::vector<std::thread> threads;
+        threads.reserve(threadCount);
+        for (unsigned int t = 0; t < threadCount; t++) {
+            threads.emplace_back(worker);
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        if (failure) {
+            std::rethrow_exception(failure);
+        }
+
+        for (size_t chunk = firstChunk; chunk < lastChunk; chunk++) {
+            for (int list = 0; list < 2; list++) {
+                const std::vector<uint64_t>& found = chunkPostings[(chunk - firstChunk) * 2 + list];
+                pending[list].insert(pending[list].end(), found.begin(), found.end());
+                if (pending[list].size() >= BLOCK_POSTINGS) {
+                    flush(list);
+                }
+            }
+        }
+    }
+    streamlines = chunkIds.back();
+}
+
+void StreamlineIndexBuilder::flush(int list) {
+    if (pending[list].empty()) {
+        return;
+    }
+    blocks[list].push_back(encodeBlock(pending[list], dims[0] * dims[1] * dims[2]));
+    pending[list].clear();
+}
+
+StreamlineIndex StreamlineIndexBuilder::finish() {
+    StreamlineIndex index;
+    for (int i = 0; i < 3; i++) {
+        index.dims[i] = dims[i];
+    }
+    index.streamlines = streamlines;
+    for (int list = 0; list < 2; list++) {
+        flush(list);
+        if (blocks[list].empty()) {
+            continue;
+        }
+        (list == 0 ? index.passing : index.endpoints) = mergeBlocks(blocks[list]);
+    }
+    streamlines = 0;
+    return index;
+}
+
+std::string streamlineIndexPath(const std::string& tractogramPath) {
+    return tractogramPath + INDEX_EXTENSION;
+}
+
+void extractStreamlines(const Tractogram& fibers, const StreamlineSelection& selection, Tractogram& out) {
+    size_t id = 0;
+    for (size_t i = 0; i < fibers.size() && id < selection.size(); i++) {
+        const size_t count = fibers.streamlineSize(i);
+        if (count == 0) {
+            continue;
+        }
+        if (selection.test(id)) {
+            out.append(fibers.streamline(i), count);
+        }
+        id++;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,126 @@
+#ifndef STREAMLINE_INDEX_H
+#define STREAMLINE_INDEX_H
+
+#include "ActiveVoxelMask.h"
+#include "Tractogram.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// One bit per streamline of an indexed tractogram; ROI queries combine these.
+class StreamlineSelection {
+private:
+    std::vector<uint64_t> words;
+    size_t streamlines;
+
+public:
+    // none selected, or every streamline with all = true
+    explicit StreamlineSelection(size_t streamlineCount = 0, bool all = false);
+
+    size_t size() const { return streamlines; }
+    void set(size_t id) { words[id >> 6] |= uint64_t(1) << (id & 63); }
+    bool test(size_t id) const { return (words[id >> 6] >> (id & 63)) & 1u; }
+    size_t count() const;
+    // selected streamline ids, ascending
+    std::vector<uint32_t> ids() const;
+
+    StreamlineSelection& operator&=(const StreamlineSelection& other);
+    StreamlineSelection& operator|=(const StreamlineSelection& other);
+    StreamlineSelection& subtract(const StreamlineSelection& other);
+};
+
+// Boolean ROI filter. A streamline is kept if it passes through every include
+// ROI, through no exclude ROI, and has an endpoint in every end ROI
+// (two end ROIs: the streamlines connecting them).
+// ROIs are voxel indices, x-fastest, as in ActiveVoxelMask.
+struct RoiQuery {
+    std::vector<std::vector<uint64_t>> include;
+    std::vector<std::vector<uint64_t>> exclude;
+    std::vector<std::vector<uint64_t>> end;
+};
+
+// Voxel -> streamline inverted index of a tractogram.
+// A streamline is listed under every voxel its polyline passes through (each
+// segment is walked voxel by voxel, so long steps skip nothing), and separately
+// under the voxels of its two endpoints. Streamline ids number the non-empty
+// streamlines in order, as TractogramWriter stores them, so an id is also the
+// streamline's position in the written file. Each voxel's ids are ascending, delta coded as LEB128
+// varints, typically 1-2 bytes an entry; only non-empty voxels are stored.
+// A query ORs the posting lists of an ROI's voxels into a bitset and the ROIs
+// are then combined with AND / AND NOT, so its cost is the number of postings
+// inside the ROIs, not the size of the tractogram.
+class StreamlineIndex {
+public:
+    struct PostingLists {
+        std::vector<uint64_t> voxels;   // ascending
+        std::vector<uint64_t> starts;   // voxels[i] is bytes[starts[i] .. starts[i + 1])
+        std::vector<uint8_t> bytes;
+    };
+
+private:
+    uint64_t dims[3];
+    uint64_t streamlines;
+    PostingLists passing;
+    PostingLists endpoints;
+
+    // ORs in the streamlines listed under voxels first .. last - 1
+    void collect(const PostingLists& lists, uint64_t first, uint64_t last, StreamlineSelection& selection) const;
+
+    friend class StreamlineIndexBuilder;
+
+public:
+    StreamlineIndex();
+
+    // in parallel over the streamlines; 0 threads means one per core
+    static StreamlineIndex build(const Tractogram& fibers, const int dimensions[3], unsigned int numThreads = 0);
+
+    const uint64_t* dimensions() const { return dims; }
+    uint64_t streamlineCount() const { return streamlines; }
+    uint64_t postingCount() const;
+    uint64_t encodedBytes() const { return passing.bytes.size() + endpoints.bytes.size(); }
+
+    StreamlineSelection passingThrough(const std::vector<uint64_t>& roi) const;
+    StreamlineSelection passingThrough(const ActiveVoxelMask& roi) const;
+    StreamlineSelection endingIn(const std::vector<uint64_t>& roi) const;
+    StreamlineSelection select(const RoiQuery& query) const;
+
+    // Kept next to the tractogram (see streamlineIndexPath). load throws for a
+    // missing, truncated, corrupt or foreign file (every posting list is decoded
+    // and checked against the header); compare streamlineCount() with the
+    // tractogram's to catch an index left over from an earlier run.
+    void save(const std::string& path) const;
+    static StreamlineIndex load(const std::string& path);
+};
+
+// Builds an index from streamlines arriving in batches, e.g. from the
+// whole-brain writer, so the tractogram never has to be held in memory.
+// Postings collect in a bounded buffer that is sorted into an encoded block
+// whenever it fills; finish() merges the blocks.
+// Volumes and tractograms are limited to 2^32 voxels and streamlines.
+class StreamlineIndexBuilder {
+private:
+    uint64_t dims[3];
+    unsigned int numThreads;
+    uint64_t streamlines;
+    // [0] passing through, [1] endpoints; pending entries are voxel << 32 | streamline id
+    std::vector<uint64_t> pending[2];
+    std::vector<StreamlineIndex::PostingLists> blocks[2];
+
+    void flush(int list);
+
+public:
+    explicit StreamlineIndexBuilder(const int dimensions[3], unsigned int numThreads = 1);
+
+    // fibers' non-empty streamlines get the next ids, in order
+    void add(const Tractogram& fibers);
+    StreamlineIndex finish();
+};
+
+// <tractogram path>.sidx
+std::string streamlineIndexPath(const std::string& tractogramPath);
+
+// the selected streamlines of the fibers an index was built from, in order, appended to out
+void extractStreamlines(const Tractogram& fibers, const StreamlineSelection& selection, Tractogram& out);
+
+#endif // STREAMLINE_INDEX_H
\ No newline at end of file
@@ -0,0 +1,191 @@
+#include "StreamlineIntegrator.h"
+#include "RunMetrics.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+
+void recordTermination(StreamlineTermination reason) {
+    switch (reason) {
+        case StreamlineTermination::Bounds: RunMetrics::add(MetricCounter::TerminationBounds); break;
+        case StreamlineTermination::Mask: RunMetrics::add(MetricCounter::TerminationMask); break;
+        case StreamlineTermination::FA: RunMetrics::add(MetricCounter::TerminationFA); break;
+        case StreamlineTermination::Curvature: RunMetrics::add(MetricCounter::TerminationCurvature); break;
+        case StreamlineTermination::Length: RunMetrics::add(MetricCounter::TerminationLength); break;
+        case StreamlineTermination::None: break;
+    }
+}
+
+// once per streamline, never per step
+void recordStreamline(const StreamlineResult& result) {
+    if (!RunMetrics::enabled()) {
+        return;
+    }
+    RunMetrics::add(MetricCounter::Streamlines);
+    RunMetrics::add(MetricCounter::StepsIntegrated, result.pointCount > 0 ? result.pointCount - 1 : 0);
+    recordTermination(result.backward);
+    recordTermination(result.forward);
+}
+
+}
+
+StreamlineIntegrator::StreamlineIntegrator() : mask(nullptr) {
+    setParameters(StreamlineParameters());
+}
+
+StreamlineIntegrator::StreamlineIntegrator(const TrackingSampler& volumeSampler, const ActiveVoxelMask* activeMask)
+    : sampler(volumeSampler), mask(activeMask) {
+    setParameters(StreamlineParameters());
+}
+
+void StreamlineIntegrator::setParameters(const StreamlineParameters& newParams) {
+    // also rejects NaN; the step count below must be finite
+    if (!(newParams.stepSize > 0.0)) {
+        throw std::runtime_error("Streamline step size must be positive");
+    }
+    params = newParams;
+    minCosAngle = std::cos(params.maxAngleDegrees * M_PI / 180.0);
+    const double steps = params.maxLength / params.stepSize;
+    maxSteps = steps >= static_cast<double>(std::numeric_limits<int>::max()) ? std::numeric_limits<int>::max()
+                                                                              : (steps > 0.0 ? static_cast<int>(steps) : 0);
+}
+
+StreamlineTermination StreamlineIntegrator::sampleDirection(const Point& point, const Point& reference, Point& direction) const {
+    if (!sampler.isInside(point)) {
+        return StreamlineTermination::Bounds;
+    }
+    DirectionFAVoxel voxel = params.trilinear ? sampler.trilinear(point) : sampler.nearest(point);
+    if (voxel.fa < params.minFA) {
+        return StreamlineTermination::FA;
+    }
+
+    double norm = std::sqrt(voxel.direction[0] * voxel.direction[0] +
+                            voxel.direction[1] * voxel.direction[1] +
+                            voxel.direction[2] * voxel.direction[2]);
+    if (norm == 0.0) {
+        return StreamlineTermination::FA;
+    }
+
+    // e1 and -e1 are the same axis: keep heading the way we came
+    double dot = voxel.direction[0] * reference[0] + voxel.direction[1] * reference[1] + voxel.direction[2] * reference[2];
+    double scale = (dot < 0.0 ? -1.0 : 1.0) / norm;
+    for (int i = 0; i < 3; i++) {
+        direction[i] = voxel.direction[i] * scale;
+    }
+    return StreamlineTermination::None;
+}
+
+// Advances point by one step. On entry direction is the incoming heading and k1 the
+// field at point; on success both are updated for the new point, so every step
+// costs one gather for Euler (2 for RK2, 4 for RK4).
+StreamlineTermination StreamlineIntegrator::step(Point& point, Point& direction, Point& k1) const {
+    const double h = params.stepSize;
+    Point k2, k3, k4, probe, next;
+    StreamlineTermination stop = StreamlineTermination::None;
+
+    switch (params.method) {
+        case IntegrationMethod::Euler:
+            next = k1;
+            break;
+        case IntegrationMethod::RK2:
+            for (int i = 0; i < 3; i++) probe[i] = point[i] + 0.5 * h * k1[i];
+            stop = sampleDirection(probe, k1, k2);
+            if (stop != StreamlineTermination::None) {
+                return stop;
+            }
+            next = k2;
+            break;
+        case IntegrationMethod::RK4:
+            for (int i = 0; i < 3; i++) probe[i] = point[i] + 0.5 * h * k1[i];
+            stop = sampleDirection(probe, k1, k2);
+            if (stop != StreamlineTermination::None) {
+                return stop;
+            }
+            for (int i = 0; i < 3; i++) probe[i] = point[i] + 0.5 * h * k2[i];
+            stop = sampleDirection(probe, k2, k3);
+            if (stop != StreamlineTermination::None) {
+                return stop;
+            }
+            for (int i = 0; i < 3; i++) probe[i] = point[i] + h * k3[i];
+            stop = sampleDirection(probe, k3, k4);
+            if (stop != StreamlineTermination::None) {
+                return stop;
+            }
+            for (int i = 0; i < 3; i++) next[i] = (k1[i] + 2.0 * k2[i] + 2.0 * k3[i] + k4[i]) / 6.0;
+            break;
+    }
+
+    double norm = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2]);
+    if (norm == 0.0) {
+        return StreamlineTermination::FA;
+    }
+    for (int i = 0; i < 3; i++) next[i] /= norm;
+
+    if (next[0] * direction[0] + next[1] * direction[1] + next[2] * direction[2] < minCosAngle) {
+        return StreamlineTermination::Curvature;
+    }
+
+    // the new point must itself be trackable, or the streamline ends before it
+    Point nextPoint;
+    for (int i = 0; i < 3; i++) nextPoint[i] = point[i] + h * next[i];
+    stop = sampleDirection(nextPoint, next, k1);
+    if (stop != StreamlineTermination::None) {
+        return stop;
+    }
+
+    point = nextPoint;
+    direction = next;
+    return StreamlineTermination::None;
+}
+
+StreamlineTermination StreamlineIntegrator::traceFront(Point point, Point direction, std::vector<Point>& points) const {
+    Point k1 = direction;
+    for (int stepCount = 0; stepCount < maxSteps; stepCount++) {
+        StreamlineTermination stop = step(point, direction, k1);
+        if (stop != StreamlineTermination::None) {
+            return stop;
+        }
+        points.push_back(point);
+    }
+    return StreamlineTermination::Length;
+}
+
+StreamlineResult StreamlineIntegrator::trace(const Point& seed, std::vector<Point>& points) const {
+    StreamlineResult result = {StreamlineTermination::Bounds, StreamlineTermination::Bounds, 0};
+    if (!sampler.isInside(seed)) {
+        return result;
+    }
+
+    const size_t first = points.size();
+    if (mask && !mask->test(static_cast<int>(seed[0]), static_cast<int>(seed[1]), static_cast<int>(seed[2]))) {
+        // background seed: not worth a gather
+        points.push_back(seed);
+        result.backward = result.forward = StreamlineTermination::Mask;
+        result.pointCount = 1;
+        recordStreamline(result);
+        return result;
+    }
+    DirectionFAVoxel voxel = sampler.nearest(seed);
+    Point axis = {voxel.direction[0], voxel.direction[1], voxel.direction[2]};
+    Point forward;
+    StreamlineTermination seedStop = sampleDirection(seed, axis, forward);
+    if (seedStop != StreamlineTermination::None) {
+        // nothing to follow from here: the seed alone
+        points.push_back(seed);
+        result.backward = result.forward = seedStop;
+        result.pointCount = 1;
+        recordStreamline(result);
+        return result;
+    }
+    Point backward = {-forward[0], -forward[1], -forward[2]};
+
+    result.backward = traceFront(seed, backward, points);
+    std::reverse(points.begin() + first, points.end());
+    points.push_back(seed);
+    result.forward = traceFront(seed, forward, points);
+    result.pointCount = points.size() - first;
+    recordStreamline(result);
+    return result;
+}
\ No newline at end of file
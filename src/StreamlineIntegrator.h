@@ -0,0 +1,73 @@
+#ifndef STREAMLINE_INTEGRATOR_H
+#define STREAMLINE_INTEGRATOR_H
+
+#include "VoxelSampler.h"
+#include "ActiveVoxelMask.h"
+#include <array>
+#include <vector>
+
+enum class IntegrationMethod {
+    Euler,
+    RK2,
+    RK4
+};
+
+// Why a front of a streamline stopped.
+enum class StreamlineTermination {
+    None,
+    Bounds,
+    Mask,
+    FA,
+    Curvature,
+    Length
+};
+
+struct StreamlineParameters {
+    IntegrationMethod method = IntegrationMethod::Euler;
+    double stepSize = 1.0;          // voxels
+    double minFA = 0.5;
+    double maxLength = 500.0;       // voxels, per front
+    double maxAngleDegrees = 60.0;  // between consecutive steps
+    bool trilinear = false;         // nearest voxel, as the trackers always sampled
+};
+
+struct StreamlineResult {
+    StreamlineTermination backward;
+    StreamlineTermination forward;
+    size_t pointCount;
+};
+
+// Deterministic streamline tracing through the direction field: one point per
+// step, one front along +e1 and one along -e1 from the seed.
+// Memory is the streamline itself; no queue and no revisits.
+class StreamlineIntegrator {
+private:
+    typedef std::array<double, 3> Point;
+
+    TrackingSampler sampler;
+    const ActiveVoxelMask* mask;
+    StreamlineParameters params;
+    double minCosAngle;
+    int maxSteps;
+
+    StreamlineTermination sampleDirection(const Point& point, const Point& reference, Point& direction) const;
+    StreamlineTermination step(Point& point, Point& direction, Point& k1) const;
+    // direction is the unit field at point, already oriented along the front
+    StreamlineTermination traceFront(Point point, Point direction, std::vector<Point>& points) const;
+
+public:
+    StreamlineIntegrator();
+    // A seed outside mask (if given) is not traced: its streamline is the seed alone.
+    // Fronts end on minFA, not on the mask, so each step stays a single gather.
+    StreamlineIntegrator(const TrackingSampler& sampler, const ActiveVoxelMask* mask);
+
+    // throws for a step size that is not positive
+    void setParameters(const StreamlineParameters& newParams);
+    const StreamlineParameters& getParameters() const { return params; }
+
+    // Appends the streamline through seed to points, ordered backward end -> seed -> forward end.
+    // A seed outside the volume appends nothing.
+    StreamlineResult trace(const Point& seed, std::vector<Point>& points) const;
+};
+
+#endif // STREAMLINE_INTEGRATOR_H
\ No newline at end of file
@@ -0,0 +1,165 @@
+#include "StreamlineLOD.h"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+namespace {
+
+// streamlines a worker simplifies at a time
+const size_t STREAMLINES_PER_CHUNK = 1024;
+
+// squared distance from p to the segment a-b
+double segmentDistance2(const Tractogram::Point& p, const Tractogram::Point& a, const Tractogram::Point& b) {
+    double ab[3];
+    double ap[3];
+    double lengthSquared = 0.0;
+    double along = 0.0;
+    for (int k = 0; k < 3; k++) {
+        ab[k] = static_cast<double>(b[k]) - a[k];
+        ap[k] = static_cast<double>(p[k]) - a[k];
+        lengthSquared += ab[k] * ab[k];
+        along += ab[k] * ap[k];
+    }
+    const double t = lengthSquared > 0.0 ? std::min(1.0, std::max(0.0, along / lengthSquared)) : 0.0;
+    double distance = 0.0;
+    for (int k = 0; k < 3; k++) {
+        const double d = ap[k] - t * ab[k];
+        distance += d * d;
+    }
+    return distance;
+}
+
+// Douglas-Peucker without recursion: keep[i] marks the points that survive.
+void markKeptPoints(const Tractogram::Point* points, size_t count, double tolerance2, std::vector<char>& keep,
+                    std::vector<std::pair<size_t, size_t>>& ranges) {
+    keep.assign(count, 0);
+    keep[0] = 1;
+    keep[count - 1] = 1;
+    ranges.clear();
+    if (count > 2) {
+        ranges.push_back({0, count - 1});
+    }
+    while (!ranges.empty()) {
+        const size_t first = ranges.back().first;
+        const size_t last = ranges.back().second;
+        ranges.pop_back();
+
+        size_t farthest = first;
+        double farthestDistance = tolerance2;
+        for (size_t i = first + 1; i < last; i++) {
+            const double distance = segmentDistance2(points[i], points[first], points[last]);
+            if (distance > farthestDistance) {
+                farthest = i;
+                farthestDistance = distance;
+            }
+        }
+        if (farthest == first) {
+            continue;
+        }
+        keep[farthest] = 1;
+        if (farthest - first > 1) {
+            ranges.push_back({first, farthest});
+        }
+        if (last - farthest > 1) {
+            ranges.push_back({farthest, last});
+        }
+    }
+}
+
+void simplifyRange(const Tractogram& fibers, size_t first, size_t last, const StreamlineLODLevel& level,
+                   SimplifiedTractogram& out) {
+    const double tolerance2 = level.tolerance * level.tolerance;
+    const size_t stride = std::max(1u, level.streamlineStride);
+    std::vector<char> keep;
+    std::vector<std::pair<size_t, size_t>> ranges;
+    std::vector<Tractogram::Point> kept;
+
+    // stride counts from streamline 0, whatever chunk the streamline falls in
+    for (size_t i = (first + stride - 1) / stride * stride; i < last; i += stride) {
+        const size_t count = fibers.streamlineSize(i);
+        if (count == 0) {
+            continue;
+        }
+        const Tractogram::Point* points = fibers.streamline(i);
+        const uint64_t base = fibers.offsets()[i];
+        markKeptPoints(points, count, tolerance2, keep, ranges);
+
+        kept.clear();
+        for (size_t p = 0; p < count; p++) {
+            if (keep[p]) {
+                kept.push_back(points[p]);
+                out.sourcePoints.push_back(base + p);
+            }
+        }
+        out.fibers.append(kept.data(), kept.size());
+    }
+}
+
+}
+
+SimplifiedTractogram simplifyStreamlines(const Tractogram& fibers, const StreamlineLODLevel& level, unsigned int numThreads) {
+    const size_t chunkCount = (fibers.size() + STREAMLINES_PER_CHUNK - 1) / STREAMLINES_PER_CHUNK;
+    numThreads = numThreads > 0 ? numThreads : std::max(1u, std::thread::hardware_concurrency());
+    const unsigned int threadCount = static_cast<unsigned int>(std::max<size_t>(1, std::min<size_t>(numThreads, chunkCount)));
+
+    SimplifiedTractogram simplified;
+    if (threadCount == 1) {
+        simplifyRange(fibers, 0, fibers.size(), level, simplified);
+        return simplified;
+    }
+
+    // chunks, not threads, own the partial results, so the output never depends on scheduling
+    std::vector<SimplifiedTractogram> chunks(chunkCount);
+    std::atomic<size_t> nextChunk(0);
+    std::exception_ptr failure;
+    std::mutex failureMutex;
+
+    auto worker = [&]() {
+        try {
+            for (size_t chunk = nextChunk++; chunk < chunkCount; chunk = nextChunk++) {
+                const size_t first = chunk * STREAMLINES_PER_CHUNK;
+                simplifyRange(fibers, first, std::min(first + STREAMLINES_PER_CHUNK, fibers.size()), level, chunks[chunk]);
+            }
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(failureMutex);
+            if (!failure) {
+                failure = std::current_exception();
+            }
+            nextChunk = chunkCount;
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(threadCount);
+    for (unsigned int t = 0; t < threadCount; t++) {
+        threads.emplace_back(worker);
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    if (failure) {
+        std::rethrow_exception(failure);
+    }
+
+    size_t streamlines = 0;
+    size_t points = 0;
+    for (const auto& chunk : chunks) {
+        streamlines += chunk.fibers.size();
+        points += chunk.fibers.pointCount();
+    }
+    simplified.fibers.reserve(streamlines, points);
+    simplified.sourcePoints.reserve(points);
+    for (auto& chunk : chunks) {
+        simplified.fibers.append(chunk.fibers);
+        simplified.sourcePoints.insert(simplified.sourcePoints.end(), chunk.sourcePoints.begin(), chunk.sourcePoints.end());
+        chunk = SimplifiedTractogram();
+    }
+    return simplified;
+}
+
+std::vector<StreamlineLODLevel> defaultStreamlineLODLevels() {
+    return {{0.25, 1}, {1.0, 4}};
+}
\ No newline at end of file
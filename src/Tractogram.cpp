@@ -0,0 +1,129 @@
+#include "Tractogram.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+void Tractogram::clear() {
+    arena.clear();
+    offsetTable.assign(1, 0);
+}
+
+void Tractogram::reserve(size_t streamlines, size_t points) {
+    arena.reserve(points);
+    offsetTable.reserve(streamlines + 1);
+}
+
+void Tractogram::append(const std::array<double, 3>* points, size_t count) {
+    size_t first = arena.size();
+    arena.resize(first + count);
+    for (size_t i = 0; i < count; i++) {
+        arena[first + i] = {static_cast<float>(points[i][0]), static_cast<float>(points[i][1]),
+                            static_cast<float>(points[i][2])};
+    }
+    offsetTable.push_back(arena.size());
+}
+
+void Tractogram::append(const Point* points, size_t count) {
+    arena.insert(arena.end(), points, points + count);
+    offsetTable.push_back(arena.size());
+}
+
+void Tractogram::append(const Tractogram& other) {
+    const uint64_t base = arena.size();
+    arena.insert(arena.end(), other.arena.begin(), other.arena.end());
+    offsetTable.reserve(offsetTable.size() + other.size());
+    for (size_t i = 1; i < other.offsetTable.size(); i++) {
+        offsetTable.push_back(base + other.offsetTable[i]);
+    }
+}
+
+void Tractogram::assign(std::vector<Point>&& points, std::vector<uint64_t>&& offsets) {
+    if (offsets.empty() || offsets.front() != 0 || offsets.back() != points.size() ||
+        !std::is_sorted(offsets.begin(), offsets.end())) {
+        throw std::runtime_error("Streamline offsets do not match the point arena");
+    }
+    arena = std::move(points);
+    offsetTable = std::move(offsets);
+}
+
+Tractogram::Point* Tractogram::resize(size_t streamlines, size_t points, uint64_t*& offsets) {
+    arena.resize(points);
+    offsetTable.resize(streamlines + 1);
+    offsets = offsetTable.data();
+    return arena.data();
+}
+
+TractogramChunkBuilder::TractogramChunkBuilder(size_t pointsPerChunk)
+    : chunkPoints(std::max<size_t>(1, pointsPerChunk)), activeChunk(0), totalPoints(0) {}
+
+void TractogramChunkBuilder::add(uint64_t key, const std::array<double, 3>* points, size_t count) {
+    if (chunks.empty()) {
+        chunks.emplace_back();
+        chunks.back().reserve(chunkPoints);
+    }
+    std::vector<Tractogram::Point>* chunk = &chunks[activeChunk];
+    if (chunk->size() + count > chunk->capacity()) {
+        // next chunk, reusing one left over from an earlier run if it is big enough
+        activeChunk++;
+        if (activeChunk == chunks.size()) {
+            chunks.emplace_back();
+        }
+        chunk = &chunks[activeChunk];
+        chunk->clear();
+        chunk->reserve(std::max(chunkPoints, count));
+    }
+
+    Entry entry;
+    entry.key = key;
+    entry.chunk = static_cast<uint32_t>(activeChunk);
+    entry.count = static_cast<uint32_t>(count);
+    entry.begin = chunk->size();
+    for (size_t i = 0; i < count; i++) {
+        chunk->push_back({static_cast<float>(points[i][0]), static_cast<float>(points[i][1]),
+                          static_cast<float>(points[i][2])});
+    }
+    entryList.push_back(entry);
+    totalPoints += count;
+}
+
+void TractogramChunkBuilder::clear() {
+    for (auto& chunk : chunks) {
+        chunk.clear();
+    }
+    activeChunk = 0;
+    entryList.clear();
+    totalPoints = 0;
+}
+
+void mergeTractogramChunks(const std::vector<TractogramChunkBuilder>& builders, size_t streamlineCount, Tractogram& out) {
+    std::vector<const TractogramChunkBuilder::Entry*> byKey(streamlineCount, nullptr);
+    std::vector<const TractogramChunkBuilder*> owner(streamlineCount, nullptr);
+    uint64_t addedPoints = 0;
+    for (const auto& builder : builders) {
+        for (const auto& entry : builder.entries()) {
+            if (entry.key >= streamlineCount || byKey[entry.key]) {
+                throw std::runtime_error("Streamline keys must be unique and below the streamline count");
+            }
+            byKey[entry.key] = &entry;
+            owner[entry.key] = &builder;
+        }
+        addedPoints += builder.pointCount();
+    }
+    if (std::find(byKey.begin(), byKey.end(), nullptr) != byKey.end()) {
+        throw std::runtime_error("Streamline key missing from every builder");
+    }
+
+    const size_t firstStreamline = out.size();
+    const uint64_t firstPoint = out.pointCount();
+    uint64_t* offsets;
+    Tractogram::Point* points = out.resize(firstStreamline + streamlineCount, firstPoint + addedPoints, offsets);
+
+    uint64_t cursor = firstPoint;
+    for (size_t i = 0; i < streamlineCount; i++) {
+        const TractogramChunkBuilder::Entry& entry = *byKey[i];
+        std::memcpy(points + cursor, owner[i]->data(entry), entry.count * sizeof(Tractogram::Point));
+        cursor += entry.count;
+        offsets[firstStreamline + i + 1] = cursor;
+    }
+}
\ No newline at end of file
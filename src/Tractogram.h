@@ -0,0 +1,84 @@
+#ifndef TRACTOGRAM_H
+#define TRACTOGRAM_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// All streamlines of a run in compressed sparse row form: every point in one
+// float32 arena, xyz packed (12 bytes a point, half of a double triple), and
+// streamline i is points()[offsets()[i] .. offsets()[i + 1]).
+// Tracker coordinates stay below a few hundred voxels, where float still
+// resolves ~1e-5 voxel, far finer than any step size.
+// Empty streamlines (e.g. a seed outside the volume) keep their slot.
+class Tractogram {
+public:
+    typedef std::array<float, 3> Point;
+
+private:
+    std::vector<Point> arena;
+    std::vector<uint64_t> offsetTable;  // always starts with 0
+
+public:
+    Tractogram() : offsetTable(1, 0) {}
+
+    size_t size() const { return offsetTable.size() - 1; }
+    size_t pointCount() const { return arena.size(); }
+    bool empty() const { return offsetTable.size() == 1; }
+
+    const std::vector<Point>& points() const { return arena; }
+    const std::vector<uint64_t>& offsets() const { return offsetTable; }
+    const Point* streamline(size_t i) const { return arena.data() + offsetTable[i]; }
+    size_t streamlineSize(size_t i) const { return static_cast<size_t>(offsetTable[i + 1] - offsetTable[i]); }
+
+    void clear();
+    void reserve(size_t streamlines, size_t points);
+    // one streamline; tracker points are converted once, here
+    void append(const std::array<double, 3>* points, size_t count);
+    void append(const Point* points, size_t count);
+    // every streamline of other, after the ones already here
+    void append(const Tractogram& other);
+    // takes both arrays over without a copy; throws unless offsets is a valid table for points
+    void assign(std::vector<Point>&& points, std::vector<uint64_t>&& offsets);
+    // the arena and offset table, sized for the given totals, for bulk fills
+    Point* resize(size_t streamlines, size_t points, uint64_t*& offsets);
+};
+
+// Per-thread streamline storage for parallel tracing. Points go into fixed-size
+// chunks that are never reallocated, so growing never copies earlier streamlines,
+// and clear() keeps the chunks for the next run. A streamline stays within one
+// chunk; one longer than a chunk gets a chunk of its own size.
+class TractogramChunkBuilder {
+public:
+    struct Entry {
+        uint64_t key;       // e.g. the seed index
+        uint32_t chunk;
+        uint32_t count;
+        size_t begin;
+    };
+
+private:
+    std::vector<std::vector<Tractogram::Point>> chunks;
+    std::vector<Entry> entryList;
+    size_t chunkPoints;
+    size_t activeChunk;
+    uint64_t totalPoints;
+
+public:
+    explicit TractogramChunkBuilder(size_t chunkPoints = size_t(1) << 16);
+
+    void add(uint64_t key, const std::array<double, 3>* points, size_t count);
+    void clear();
+
+    const std::vector<Entry>& entries() const { return entryList; }
+    uint64_t pointCount() const { return totalPoints; }
+    const Tractogram::Point* data(const Entry& entry) const { return chunks[entry.chunk].data() + entry.begin; }
+};
+
+// Appends the streamlines of all builders to out in key order. Keys must be
+// 0 .. streamlineCount - 1, each added to exactly one builder. The arena grows
+// once to its final size and every streamline is copied once.
+void mergeTractogramChunks(const std::vector<TractogramChunkBuilder>& builders, size_t streamlineCount, Tractogram& out);
+
+#endif // TRACTOGRAM_H
\ No newline at end of file
@@ -0,0 +1,284 @@
+#include "TractogramCache.h"
+#include "MappedFile.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+const char ENTRY_MAGIC[8] = {'F', 'I', 'B', 'C', 'A', 'C', 'H', 'E'};
+const uint64_t ENTRY_VERSION = 2;   // 2: float32 points
+const char ENTRY_EXTENSION[] = ".fibers";
+
+// bumped whenever tracing changes in a way the parameters do not capture
+const char TRACKER_REVISION[] = "streamline-integrator-1";
+
+inline uint64_t rotl(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+inline uint64_t finalMix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+struct FileDigest {
+    off_t size;
+    struct timespec modified;
+    uint64_t lanes[2];
+};
+
+// hashing a subject's volumes is the bulk of a cache lookup: do it once per file version
+std::mutex digestMutex;
+std::map<std::string, FileDigest> fileDigests;
+
+struct EntryInfo {
+    std::string path;
+    struct timespec used;
+    uint64_t bytes;
+};
+
+bool olderThan(const EntryInfo& a, const EntryInfo& b) {
+    if (a.used.tv_sec != b.used.tv_sec) {
+        return a.used.tv_sec < b.used.tv_sec;
+    }
+    return a.used.tv_nsec < b.used.tv_nsec;
+}
+
+// each build-time tracking record type (VoxelSampler.h) traces slightly different streamlines
+const char* trackingRecordTag(const DirectionFAVoxel*) { return "record-float32"; }
+const char* trackingRecordTag(const OctahedralVoxel16*) { return "record-oct16"; }
+const char* trackingRecordTag(const OctahedralVoxel8*) { return "record-oct8"; }
+
+bool hasEntryExtension(const char* name) {
+    size_t length = std::strlen(name);
+    size_t extension = sizeof(ENTRY_EXTENSION) - 1;
+    return length > extension && std::strcmp(name + length - extension, ENTRY_EXTENSION) == 0;
+}
+
+}
+
+TractogramCacheKey::TractogramCacheKey() {
+    lanes[0] = 0x9e3779b97f4a7c15ULL;
+    lanes[1] = 0x6a09e667f3bcc909ULL;
+    addString(TRACKER_REVISION);
+    addString(trackingRecordTag(static_cast<const TrackingRecord*>(nullptr)));
+}
+
+void TractogramCacheKey::addWords(const void* data, size_t size) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    uint64_t a = lanes[0];
+    uint64_t b = lanes[1];
+
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, bytes + i, 8);
+        a = rotl(a ^ (word * 0x87c37b91114253d5ULL), 31) * 0x4cf5ad432745937fULL;
+        b = rotl(b ^ (word * 0x4cf5ad432745937fULL), 33) * 0x87c37b91114253d5ULL;
+    }
+    uint64_t tail = 0;
+    std::memcpy(&tail, bytes + i, size - i);
+    tail ^= static_cast<uint64_t>(size) << 56 ^ size;
+    a = rotl(a ^ (tail * 0x87c37b91114253d5ULL), 31) * 0x4cf5ad432745937fULL;
+    b = rotl(b ^ (tail * 0x4cf5ad432745937fULL), 33) * 0x87c37b91114253d5ULL;
+
+    lanes[0] = a + b;
+    lanes[1] = b + a * 3;
+}
+
+void TractogramCacheKey::addFile(const std::string& path) {
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0) {
+        throw std::runtime_error("Cannot stat " + path);
+    }
+
+    uint64_t digest[2];
+    {
+        std::lock_guard<std::mutex> lock(digestMutex);
+        auto found = fileDigests.find(path);
+        if (found != fileDigests.end() && found->second.size == info.st_size &&
+            found->second.modified.tv_sec == info.st_mtim.tv_sec &&
+            found->second.modified.tv_nsec == info.st_mtim.tv_nsec) {
+            digest[0] = found->second.lanes[0];
+            digest[1] = found->second.lanes[1];
+            addWords(digest, sizeof(digest));
+            return;
+        }
+    }
+
+    MappedFile file(path);
+    TractogramCacheKey content;
+    content.addWords(file.data(), file.size());
+    digest[0] = content.lanes[0];
+    digest[1] = content.lanes[1];
+
+    {
+        std::lock_guard<std::mutex> lock(digestMutex);
+        FileDigest& entry = fileDigests[path];
+        entry.size = info.st_size;
+        entry.modified = info.st_mtim;
+        entry.lanes[0] = digest[0];
+        entry.lanes[1] = digest[1];
+    }
+    addWords(digest, sizeof(digest));
+}
+
+void TractogramCacheKey::addString(const std::string& value) {
+    addWords(value.data(), value.size());
+}
+
+void TractogramCacheKey::addParameters(const StreamlineParameters& params) {
+    const double values[6] = {static_cast<double>(params.method), params.stepSize, params.minFA,
+                              params.maxLength, params.maxAngleDegrees, params.trilinear ? 1.0 : 0.0};
+    addWords(values, sizeof(values));
+}
+
+void TractogramCacheKey::addSeeds(const std::vector<std::array<double, 3>>& seeds) {
+    addWords(seeds.data(), seeds.size() * sizeof(seeds[0]));
+}
+
+std::string TractogramCacheKey::hex() const {
+    char digits[33];
+    std::snprintf(digits, sizeof(digits), "%016llx%016llx",
+                  static_cast<unsigned long long>(finalMix(lanes[0])),
+                  static_cast<unsigned long long>(finalMix(lanes[1] ^ lanes[0])));
+    return digits;
+}
+
+TractogramCache::TractogramCache(const std::string& cacheDirectory, uint64_t maxCacheBytes)
+    : directory(cacheDirectory), maxBytes(maxCacheBytes) {
+    if (mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST) {
+        throw std::runtime_error("Cannot create cache directory " + directory);
+    }
+}
+
+std::string TractogramCache::entryPath(const TractogramCacheKey& key) const {
+    return directory + "/" + key.hex() + ENTRY_EXTENSION;
+}
+
+bool TractogramCache::load(const TractogramCacheKey& key, Tractogram& fibers) const {
+    const std::string path = entryPath(key);
+    if (access(path.c_str(), R_OK) != 0) {
+        return false;
+    }
+
+    try {
+        MappedFile file(path);
+        const char* bytes = static_cast<const char*>(file.data());
+        const size_t headerBytes = sizeof(ENTRY_MAGIC) + 3 * sizeof(uint64_t);
+        if (file.size() < headerBytes || std::memcmp(bytes, ENTRY_MAGIC, sizeof(ENTRY_MAGIC)) != 0) {
+            return false;
+        }
+
+        uint64_t fields[3];
+        std::memcpy(fields, bytes + sizeof(ENTRY_MAGIC), sizeof(fields));
+        const uint64_t pointCount = fields[1];
+        const uint64_t offsetCount = fields[2];
+        if (fields[0] != ENTRY_VERSION ||
+            file.size() != headerBytes + pointCount * sizeof(Point) + offsetCount * sizeof(uint64_t)) {
+            return false;
+        }
+
+        // the entry is the arena and offset table verbatim
+        const char* cursor = bytes + headerBytes;
+        std::vector<Point> points(pointCount);
+        std::memcpy(points.data(), cursor, pointCount * sizeof(Point));
+        cursor += pointCount * sizeof(Point);
+
+        std::vector<uint64_t> offsets(offsetCount);
+        std::memcpy(offsets.data(), cursor, offsetCount * sizeof(uint64_t));
+        fibers.assign(std::move(points), std::move(offsets));
+    } catch (const std::exception&) {
+        // removed by another process's eviction between access() and the mapping
+        return false;
+    }
+
+    // most recently used now
+    utimensat(AT_FDCWD, path.c_str(), nullptr, 0);
+    return true;
+}
+
+void TractogramCache::store(const TractogramCacheKey& key, const Tractogram& fibers) const {
+    const std::vector<Point>& points = fibers.points();
+    const std::vector<uint64_t>& offsets = fibers.offsets();
+    const uint64_t fields[3] = {ENTRY_VERSION, points.size(), offsets.size()};
+    const uint64_t bytes = sizeof(ENTRY_MAGIC) + sizeof(fields) + points.size() * sizeof(Point) + offsets.size() * sizeof(uint64_t);
+    if (bytes > maxBytes) {
+        return;
+    }
+
+    // write aside and rename, so concurrent runs never see a partial entry
+    const std::string path = entryPath(key);
+    const std::string partial = path + ".tmp" + std::to_string(getpid());
+    {
+        std::ofstream out(partial, std::ios::binary | std::ios::trunc);
+        out.write(ENTRY_MAGIC, sizeof(ENTRY_MAGIC));
+        out.write(reinterpret_cast<const char*>(fields), sizeof(fields));
+        out.write(reinterpret_cast<const char*>(points.data()), points.size() * sizeof(Point));
+        out.write(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(uint64_t));
+        if (!out) {
+            std::cerr << "Tractogram cache: cannot write " << partial << std::endl;
+            out.close();
+            unlink(partial.c_str());
+            return;
+        }
+    }
+    if (rename(partial.c_str(), path.c_str()) != 0) {
+        std::cerr << "Tractogram cache: cannot store " << path << std::endl;
+        unlink(partial.c_str());
+        return;
+    }
+    evict();
+}
+
+void TractogramCache::evict() const {
+    DIR* dir = opendir(directory.c_str());
+    if (!dir) {
+        return;
+    }
+
+    std::vector<EntryInfo> entries;
+    uint64_t total = 0;
+    while (struct dirent* item = readdir(dir)) {
+        if (!hasEntryExtension(item->d_name)) {
+            continue;
+        }
+        EntryInfo entry;
+        entry.path = directory + "/" + item->d_name;
+        struct stat info;
+        if (stat(entry.path.c_str(), &info) != 0) {
+            continue;
+        }
+        entry.used = info.st_mtim;
+        entry.bytes = static_cast<uint64_t>(info.st_size);
+        total += entry.bytes;
+        entries.push_back(entry);
+    }
+    closedir(dir);
+
+    std::sort(entries.begin(), entries.end(), olderThan);
+    for (const auto& entry : entries) {
+        if (total <= maxBytes) {
+            break;
+        }
+        if (unlink(entry.path.c_str()) == 0) {
+            total -= entry.bytes;
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,56 @@
+#ifndef TRACTOGRAM_CACHE_H
+#define TRACTOGRAM_CACHE_H
+
+#include "StreamlineIntegrator.h"
+#include "Tractogram.h"
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// 128-bit digest of everything a traced tractogram depends on.
+// Input files are hashed by content, so a copied or renamed subject still hits
+// and an edited one never does. Every key also covers the tracker revision and
+// the build's tracking record type, so builds never share entries.
+class TractogramCacheKey {
+private:
+    uint64_t lanes[2];
+
+    void addWords(const void* data, size_t size);
+
+public:
+    TractogramCacheKey();
+
+    void addFile(const std::string& path);
+    void addString(const std::string& value);
+    void addParameters(const StreamlineParameters& params);
+    void addSeeds(const std::vector<std::array<double, 3>>& seeds);
+
+    // 32 hex digits, used as the entry's file name
+    std::string hex() const;
+};
+
+// On-disk cache of traced fibers, one file per key, bounded to maxBytes.
+// Eviction is least recently used: a hit refreshes the entry's modification
+// time and the oldest entries go first when a store pushes the total over the limit.
+// Entries hold the tracker's own arena and offsets, so a hit is bit-identical
+// to re-tracing and loads at disk speed.
+class TractogramCache {
+private:
+    typedef Tractogram::Point Point;
+
+    std::string directory;
+    uint64_t maxBytes;
+
+    std::string entryPath(const TractogramCacheKey& key) const;
+    void evict() const;
+
+public:
+    TractogramCache(const std::string& directory, uint64_t maxBytes);
+
+    bool load(const TractogramCacheKey& key, Tractogram& fibers) const;
+    // Failures to write are reported and otherwise ignored; the cache is only an accelerator.
+    void store(const TractogramCacheKey& key, const Tractogram& fibers) const;
+};
+
+#endif // TRACTOGRAM_CACHE_H
\ No newline at end of file
@@ -0,0 +1,396 @@
+#include "TractogramIO.h"
+#include "RunMetrics.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+
+const size_t TRK_HEADER_SIZE = 1000;
+const size_t TRK_DIM = 6;
+const size_t TRK_VOXEL_SIZE = 12;
+const size_t TRK_N_SCALARS = 36;
+const size_t TRK_N_PROPERTIES = 238;
+const size_t TRK_VOX_TO_RAS = 440;
+const size_t TRK_VOXEL_ORDER = 948;
+const size_t TRK_N_COUNT = 988;
+const size_t TRK_VERSION = 992;
+const size_t TRK_HDR_SIZE = 996;
+
+const char TCK_MAGIC[] = "mrtrix tracks\n";
+
+template <typename T>
+void put(char* buffer, size_t offset, T value) {
+    std::memcpy(buffer + offset, &value, sizeof(T));
+}
+
+template <typename T>
+T get(const char* buffer, size_t offset) {
+    T value;
+    std::memcpy(&value, buffer + offset, sizeof(T));
+    return value;
+}
+
+// ITK physical space is LPS, .trk/.tck are RAS: negate the first two rows
+void lpsToRas(const double lps[16], double ras[16]) {
+    for (int i = 0; i < 16; i++) {
+        ras[i] = (i < 8) ? -lps[i] : lps[i];
+    }
+}
+
+bool hasExtension(const std::string& path, const char* extension) {
+    size_t length = std::strlen(extension);
+    return path.size() >= length && path.compare(path.size() - length, length, extension) == 0;
+}
+
+}
+
+TractogramFormat tractogramFormatFromPath(const std::string& path) {
+    if (hasExtension(path, ".trk")) {
+        return TractogramFormat::Trk;
+    }
+    if (hasExtension(path, ".tck")) {
+        return TractogramFormat::Tck;
+    }
+    throw std::runtime_error("Unknown tractogram extension: " + path);
+}
+
+void TractogramHeader::voxelSize(double size[3]) const {
+    for (int col = 0; col < 3; col++) {
+        size[col] = std::sqrt(voxelToWorld[col] * voxelToWorld[col] +
+                              voxelToWorld[4 + col] * voxelToWorld[4 + col] +
+                              voxelToWorld[8 + col] * voxelToWorld[8 + col]);
+    }
+}
+
+TractogramHeader makeTractogramHeader(const int dimensions[3], const double voxelToWorld[16]) {
+    TractogramHeader header;
+    for (int i = 0; i < 3; i++) {
+        header.dimensions[i] = dimensions[i];
+    }
+    std::memcpy(header.voxelToWorld, voxelToWorld, sizeof(header.voxelToWorld));
+    return header;
+}
+
+TractogramWriter::TractogramWriter(const std::string& filePath, const TractogramHeader& tractogramHeader, size_t maxChunkBytes)
+    : format(tractogramFormatFromPath(filePath)), header(tractogramHeader), path(filePath),
+      out(filePath, std::ios::binary | std::ios::trunc), chunkBytes(maxChunkBytes), count(0), tckCountOffset(0) {
+    if (!out) {
+        throw std::runtime_error("Cannot write " + path);
+    }
+    chunk.reserve(chunkBytes + (1 << 16));
+
+    std::memset(toFile, 0, sizeof(toFile));
+    if (format == TractogramFormat::Trk) {
+        // voxel-mm: voxel corner at the origin, scaled by voxel size
+        double size[3];
+        header.voxelSize(size);
+        for (int i = 0; i < 3; i++) {
+            toFile[i * 4 + i] = size[i];
+        }
+    } else {
+        // scanner RAS: voxel centres sit at i + 0.5 in tracker coordinates
+        double ras[16];
+        lpsToRas(header.voxelToWorld, ras);
+        for (int row = 0; row < 3; row++) {
+            double shift = 0.0;
+            for (int col = 0; col < 3; col++) {
+                toFile[row * 4 + col] = ras[row * 4 + col];
+                shift += ras[row * 4 + col] * 0.5;
+            }
+            toFile[row * 4 + 3] = ras[row * 4 + 3] - shift;
+        }
+    }
+    writeHeader();
+}
+
+TractogramWriter::~TractogramWriter() {
+    try {
+        close();
+    } catch (...) {
+    }
+}
+
+void TractogramWriter::writeHeader() {
+    if (format == TractogramFormat::Trk) {
+        char buffer[TRK_HEADER_SIZE];
+        std::memset(buffer, 0, sizeof(buffer));
+        std::memcpy(buffer, "TRACK", 6);
+
+        double size[3];
+        header.voxelSize(size);
+        double ras[16];
+        lpsToRas(header.voxelToWorld, ras);
+        for (int i = 0; i < 3; i++) {
+            // dim is int16 in the TrackVis header; .tck has no such limit
+            if (header.dimensions[i] < 0 || header.dimensions[i] > std::numeric_limits<int16_t>::max()) {
+                throw std::runtime_error("Volume too large for a TrackVis header (use .tck): " + path);
+            }
+            put<int16_t>(buffer, TRK_DIM + 2 * i, static_cast<int16_t>(header.dimensions[i]));
+            put<float>(buffer, TRK_VOXEL_SIZE + 4 * i, static_cast<float>(size[i]));
+        }
+        put<int16_t>(buffer, TRK_N_SCALARS, 0);
+        put<int16_t>(buffer, TRK_N_PROPERTIES, 0);
+        for (int i = 0; i < 16; i++) {
+            put<float>(buffer, TRK_VOX_TO_RAS + 4 * i, static_cast<float>(ras[i]));
+        }
+
+        // dominant RAS direction of each voxel axis
+        const char positive[3] = {'R', 'A', 'S'};
+        const char negative[3] = {'L', 'P', 'I'};
+        for (int col = 0; col < 3; col++) {
+            int best = 0;
+            for (int row = 1; row < 3; row++) {
+                if (std::fabs(ras[row * 4 + col]) > std::fabs(ras[best * 4 + col])) {
+                    best = row;
+                }
+            }
+            buffer[TRK_VOXEL_ORDER + col] = ras[best * 4 + col] >= 0 ? positive[best] : negative[best];
+        }
+
+        put<int32_t>(buffer, TRK_N_COUNT, 0);
+        put<int32_t>(buffer, TRK_VERSION, 2);
+        put<int32_t>(buffer, TRK_HDR_SIZE, static_cast<int32_t>(TRK_HEADER_SIZE));
+        out.write(buffer, sizeof(buffer));
+    } else {
+        // fixed-width count and offset, so both can be patched/known up front
+        std::string text = TCK_MAGIC;
+        text += "datatype: Float32LE\n";
+        tckCountOffset = text.size() + std::strlen("count: ");
+        text += "count: 0000000000\n";
+        const size_t fileLineLength = std::strlen("file: . 0000000000\n") + std::strlen("END\n");
+        const size_t dataOffset = (text.size() + fileLineLength + 15) / 16 * 16;
+        char fileLine[32];
+        std::snprintf(fileLine, sizeof(fileLine), "file: . %010zu\n", dataOffset);
+        text += fileLine;
+        text += "END\n";
+        text.resize(dataOffset, '\0');
+        out.write(text.data(), static_cast<std::streamsize>(text.size()));
+    }
+    if (!out) {
+        throw std::runtime_error("Failed writing " + path);
+    }
+}
+
+void TractogramWriter::encode(const Point* points, size_t pointCount, std::vector<char>& bytes) const {
+    size_t first = bytes.size();
+    size_t extra = format == TractogramFormat::Trk ? sizeof(int32_t) : 3 * sizeof(float);
+    bytes.resize(first + extra + pointCount * 3 * sizeof(float));
+    char* cursor = bytes.data() + first;
+
+    if (format == TractogramFormat::Trk) {
+        put<int32_t>(cursor, 0, static_cast<int32_t>(pointCount));
+        cursor += sizeof(int32_t);
+    }
+    for (size_t i = 0; i < pointCount; i++) {
+        const Point& p = points[i];
+        float xyz[3];
+        for (int row = 0; row < 3; row++) {
+            xyz[row] = static_cast<float>(toFile[row * 4] * p[0] + toFile[row * 4 + 1] * p[1] +
+                                          toFile[row * 4 + 2] * p[2] + toFile[row * 4 + 3]);
+        }
+        std::memcpy(cursor, xyz, sizeof(xyz));
+        cursor += sizeof(xyz);
+    }
+    if (format == TractogramFormat::Tck) {
+        const float separator[3] = {std::numeric_limits<float>::quiet_NaN(), std::numeric_limits<float>::quiet_NaN(),
+                                    std::numeric_limits<float>::quiet_NaN()};
+        std::memcpy(cursor, separator, sizeof(separator));
+    }
+}
+
+void TractogramWriter::append(const std::vector<char>& bytes, uint64_t streamlines) {
+    std::lock_guard<std::mutex> lock(chunkMutex);
+    if (!out.is_open()) {
+        throw std::runtime_error("Tractogram already closed: " + path);
+    }
+    chunk.insert(chunk.end(), bytes.begin(), bytes.end());
+    count += streamlines;
+    if (chunk.size() >= chunkBytes) {
+        flushChunk();
+    }
+}
+
+void TractogramWriter::flushChunk() {
+    out.write(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+    if (!out) {
+        throw std::runtime_error("Failed writing " + path);
+    }
+    RunMetrics::add(MetricCounter::BytesWritten, chunk.size());
+    chunk.clear();
+}
+
+void TractogramWriter::writeStreamline(const Point* points, size_t pointCount) {
+    if (pointCount == 0) {
+        return;
+    }
+    std::vector<char> bytes;
+    encode(points, pointCount, bytes);
+    append(bytes, 1);
+}
+
+void TractogramWriter::writeStreamlines(const Tractogram& fibers, size_t first, size_t last) {
+    std::vector<char> bytes;
+    uint64_t streamlines = 0;
+    last = std::min(last, fibers.size());
+    for (size_t i = first; i < last; i++) {
+        size_t pointCount = fibers.streamlineSize(i);
+        if (pointCount == 0) {
+            continue;
+        }
+        encode(fibers.streamline(i), pointCount, bytes);
+        streamlines++;
+        // keep the local buffer within one chunk as well
+        if (bytes.size() >= chunkBytes) {
+            append(bytes, streamlines);
+            bytes.clear();
+            streamlines = 0;
+        }
+    }
+    if (!bytes.empty()) {
+        append(bytes, streamlines);
+    }
+}
+
+void TractogramWriter::close() {
+    std::lock_guard<std::mutex> lock(chunkMutex);
+    if (!out.is_open()) {
+        return;
+    }
+    flushChunk();
+
+    if (format == TractogramFormat::Trk) {
+        out.seekp(TRK_N_COUNT);
+        int32_t n = static_cast<int32_t>(count);
+        out.write(reinterpret_cast<const char*>(&n), sizeof(n));
+    } else {
+        const float terminator[3] = {std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity(),
+                                     std::numeric_limits<float>::infinity()};
+        out.write(reinterpret_cast<const char*>(terminator), sizeof(terminator));
+        char digits[16];
+        std::snprintf(digits, sizeof(digits), "%010llu", static_cast<unsigned long long>(count));
+        out.seekp(static_cast<std::streamoff>(tckCountOffset));
+        out.write(digits, 10);
+    }
+    out.close();
+    if (out.fail()) {
+        throw std::runtime_error("Failed writing " + path);
+    }
+}
+
+TractogramReader::TractogramReader(const std::string& path)
+    : file(std::make_shared<const MappedFile>(path)), format(tractogramFormatFromPath(path)), stride(3) {
+    std::memset(&fileHeader, 0, sizeof(fileHeader));
+    for (int i = 0; i < 4; i++) {
+        fileHeader.voxelToWorld[i * 4 + i] = 1.0;
+    }
+    if (format == TractogramFormat::Trk) {
+        indexTrk();
+    } else {
+        indexTck();
+    }
+}
+
+void TractogramReader::indexTrk() {
+    const char* bytes = static_cast<const char*>(file->data());
+    const size_t size = file->size();
+    if (size < TRK_HEADER_SIZE || std::memcmp(bytes, "TRACK", 5) != 0 ||
+        get<int32_t>(bytes, TRK_HDR_SIZE) != static_cast<int32_t>(TRK_HEADER_SIZE)) {
+        throw std::runtime_error("Not a little-endian TrackVis file");
+    }
+
+    const int scalars = get<int16_t>(bytes, TRK_N_SCALARS);
+    const int properties = get<int16_t>(bytes, TRK_N_PROPERTIES);
+    if (scalars < 0 || properties < 0) {
+        throw std::runtime_error("Corrupt TrackVis header (negative n_scalars or n_properties)");
+    }
+    stride = 3 + scalars;
+
+    double ras[16];
+    for (int i = 0; i < 16; i++) {
+        ras[i] = get<float>(bytes, TRK_VOX_TO_RAS + 4 * i);
+    }
+    for (int i = 0; i < 3; i++) {
+        fileHeader.dimensions[i] = get<int16_t>(bytes, TRK_DIM + 2 * i);
+    }
+    if (ras[15] != 0.0) {
+        lpsToRas(ras, fileHeader.voxelToWorld);  // the flip is its own inverse
+    } else {
+        // no transform recorded (old writers): voxel size only
+        for (int i = 0; i < 3; i++) {
+            fileHeader.voxelToWorld[i * 4 + i] = get<float>(bytes, TRK_VOXEL_SIZE + 4 * i);
+        }
+    }
+
+    // n_count is only a hint: every record takes at least its int32 point count
+    const int32_t declared = get<int32_t>(bytes, TRK_N_COUNT);
+    if (declared > 0) {
+        const size_t records = std::min(static_cast<size_t>(declared), (size - TRK_HEADER_SIZE) / sizeof(int32_t));
+        starts.reserve(records);
+        pointCounts.reserve(records);
+    }
+    size_t offset = TRK_HEADER_SIZE;
+    while (offset + sizeof(int32_t) <= size) {
+        const int32_t points = get<int32_t>(bytes, offset);
+        if (points < 0) {
+            throw std::runtime_error("Corrupt TrackVis file (negative point count)");
+        }
+        // points < 2^31 and stride <= 3 + 32767: no overflow in 64 bits
+        const size_t record = sizeof(int32_t) + (static_cast<size_t>(points) * stride + properties) * sizeof(float);
+        if (record > size - offset) {
+            throw std::runtime_error("Truncated TrackVis file");
+        }
+        starts.push_back(reinterpret_cast<const float*>(bytes + offset + sizeof(int32_t)));
+        pointCounts.push_back(static_cast<uint32_t>(points));
+        offset += record;
+    }
+}
+
+void TractogramReader::indexTck() {
+    const char* bytes = static_cast<const char*>(file->data());
+    const size_t size = file->size();
+    const size_t magicLength = std::strlen(TCK_MAGIC);
+    if (size < magicLength || std::memcmp(bytes, TCK_MAGIC, magicLength) != 0) {
+        throw std::runtime_error("Not an MRtrix tracks file");
+    }
+
+    size_t dataOffset = 0;
+    bool float32LE = false;
+    size_t lineStart = magicLength;
+    while (lineStart < size) {
+        const char* end = static_cast<const char*>(std::memchr(bytes + lineStart, '\n', size - lineStart));
+        if (!end) {
+            break;
+        }
+        std::string line(bytes + lineStart, end);
+        lineStart = end - bytes + 1;
+        if (line == "END") {
+            break;
+        }
+        if (line.compare(0, 9, "datatype:") == 0) {
+            float32LE = line.find("Float32LE") != std::string::npos;
+        } else if (line.compare(0, 7, "file: .") == 0) {
+            dataOffset = std::strtoull(line.c_str() + 7, nullptr, 10);
+        }
+    }
+    if (!float32LE || dataOffset == 0 || dataOffset > size || dataOffset % sizeof(float) != 0) {
+        throw std::runtime_error("Unsupported MRtrix tracks file (need Float32LE, aligned data)");
+    }
+
+    const float* values = reinterpret_cast<const float*>(bytes + dataOffset);
+    const size_t triplets = (size - dataOffset) / (3 * sizeof(float));
+    size_t first = 0;
+    for (size_t i = 0; i < triplets; i++) {
+        const float* p = values + 3 * i;
+        if (std::isnan(p[0])) {
+            starts.push_back(values + 3 * first);
+            pointCounts.push_back(static_cast<uint32_t>(i - first));
+            first = i + 1;
+        } else if (std::isinf(p[0])) {
+            break;
+        }
+    }
+}
\ No newline at end of file
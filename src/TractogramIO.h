@@ -0,0 +1,113 @@
+#ifndef TRACTOGRAM_IO_H
+#define TRACTOGRAM_IO_H
+
+#include "MappedFile.h"
+#include "Tractogram.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Streamline files for the rest of the toolchain:
+//   .trk  TrackVis v2: 1000-byte header, per streamline an int32 point count
+//         then x y z (+ scalars) float32 per point, in voxel-mm (corner origin)
+//   .tck  MRtrix: text header, then x y z float32 triplets in scanner RAS mm,
+//         NaN triplet after each streamline, Inf triplet at the end
+// Tracker points are continuous voxel coordinates where [i, i + 1) is voxel i.
+// Only little-endian float32 files are read or written.
+
+enum class TractogramFormat {
+    Trk,
+    Tck
+};
+
+// Picks the format from the file extension; throws for anything else.
+TractogramFormat tractogramFormatFromPath(const std::string& path);
+
+struct TractogramHeader {
+    int dimensions[3];
+    double voxelToWorld[16];    // row-major, voxel index -> ITK physical space (LPS), as in VolumeHeader
+
+    // voxel size along each axis, from the transform's columns
+    void voxelSize(double size[3]) const;
+};
+
+TractogramHeader makeTractogramHeader(const int dimensions[3], const double voxelToWorld[16]);
+
+// Streams streamlines to disk with bounded memory.
+// Each write call is encoded by the calling thread without a lock, then appended
+// to a shared chunk that goes to disk once it exceeds chunkBytes, so trackers can
+// feed it from all worker threads at once. Streamlines from one call stay together;
+// the order between concurrent calls is the order they reach the lock.
+// .trk stores the volume dimensions as int16: larger volumes throw, use .tck.
+class TractogramWriter {
+private:
+    typedef Tractogram::Point Point;
+
+    TractogramFormat format;
+    TractogramHeader header;
+    std::string path;
+    std::ofstream out;
+    std::mutex chunkMutex;
+    std::vector<char> chunk;
+    size_t chunkBytes;
+    uint64_t count;
+    uint64_t tckCountOffset;
+    double toFile[12];  // row-major 3x4: tracker point -> file coordinates
+
+    void writeHeader();
+    void encode(const Point* points, size_t pointCount, std::vector<char>& bytes) const;
+    void append(const std::vector<char>& bytes, uint64_t streamlines);
+    void flushChunk();
+
+public:
+    TractogramWriter(const std::string& path, const TractogramHeader& header, size_t chunkBytes = 4 << 20);
+    ~TractogramWriter();
+    TractogramWriter(const TractogramWriter&) = delete;
+    TractogramWriter& operator=(const TractogramWriter&) = delete;
+
+    void writeStreamline(const Point* points, size_t pointCount);
+    // streamlines first .. last - 1 of fibers (all by default), read straight from its arena
+    void writeStreamlines(const Tractogram& fibers, size_t first = 0, size_t last = SIZE_MAX);
+    // Flushes, patches the streamline count into the header and closes the file.
+    void close();
+    uint64_t streamlineCount() const { return count; }
+};
+
+// Points of one streamline, straight out of the mapped file.
+// Point i is data[i * stride] .. data[i * stride + 2], in the file's coordinates.
+struct StreamlineSpan {
+    const float* data;
+    size_t pointCount;
+    size_t stride;
+
+    const float* point(size_t i) const { return data + i * stride; }
+};
+
+// Maps a .trk or .tck file and indexes its streamlines in one pass; nothing is copied.
+class TractogramReader {
+private:
+    std::shared_ptr<const MappedFile> file;
+    TractogramFormat format;
+    TractogramHeader fileHeader;
+    size_t stride;
+    std::vector<const float*> starts;
+    std::vector<uint32_t> pointCounts;
+
+    void indexTrk();
+    void indexTck();
+
+public:
+    explicit TractogramReader(const std::string& path);
+
+    size_t size() const { return starts.size(); }
+    StreamlineSpan operator[](size_t i) const { return {starts[i], pointCounts[i], stride}; }
+    TractogramFormat getFormat() const { return format; }
+    const TractogramHeader& header() const { return fileHeader; }
+};
+
+#endif // TRACTOGRAM_IO_H
\ No newline at end of file
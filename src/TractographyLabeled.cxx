@@ -1,11 +1,15 @@
 #include "TractographyLabeled.h"
+#include "ActiveVoxelMask.h"
+#include "RunMetrics.h"
+#include "VoxelBFS.h"
 #include <itkImageFileReader.h>
 #include <itkImageFileWriter.h>
 #include <itkDiffusionTensor3D.h>
 #include <itkVector.h>
 #include <itkImage.h>
-#include <queue>
 #include <iostream>
+#include <memory>
+#include <stdexcept>
 
 using PixelType = itk::DiffusionTensor3D<double>;
 using ImageType = itk::Image<PixelType, 3>;
@@ -16,9 +20,10 @@ using LabelImageType = itk::Image<unsigned char, 3>;
 using OutputImageType = itk::Image<unsigned int, 3>;
 using IndexType = ImageType::IndexType;
 
-void PerformTractographyLabeled(const std::string &tensorImagePath, const std::string &faImagePath, const std::string &labelImagePath, const std::string &eigenvectorImagePath, const std::string &outputImagePath)
+void PerformTractographyLabeled(const std::string &tensorImagePath, const std::string &faImagePath, const std::string &labelImagePath, const std::string &eigenvectorImagePath, const std::string &outputImagePath, const std::string &maskPath)
 {
     std::cout << "Task started: Tractography - Labeled" << std::endl;
+    StageTimer timer("voxel_bfs_labeled");
 	
 	// read principal eigenvector image
     auto eigenvectorReader = itk::ImageFileReader<VectorImageType>::New();
@@ -41,6 +46,17 @@ void PerformTractographyLabeled(const std::string &tensorImagePath, const std::s
     VectorImageType::Pointer eigenvectorImage = eigenvectorReader->GetOutput();
     FAImageType::RegionType region = faImage->GetLargestPossibleRegion();
 
+    // the BFS and the seed scan index every buffer by FA voxel: each image must be FA's grid, whole
+    if (faImage->GetBufferedRegion() != region) {
+        throw std::runtime_error("FA image not fully buffered: " + faImagePath);
+    }
+    if (eigenvectorImage->GetLargestPossibleRegion() != region || eigenvectorImage->GetBufferedRegion() != region) {
+        throw std::runtime_error("Eigenvector image does not match FA image: " + eigenvectorImagePath);
+    }
+    if (labelImage->GetLargestPossibleRegion() != region || labelImage->GetBufferedRegion() != region) {
+        throw std::runtime_error("Label image does not match FA image: " + labelImagePath);
+    }
+
     // initialize output image
     OutputImageType::Pointer outputImage = OutputImageType::New();
     outputImage->SetRegions(region);
@@ -50,46 +66,45 @@ void PerformTractographyLabeled(const std::string &tensorImagePath, const std::s
     outputImage->Allocate();
     outputImage->FillBuffer(0);
 
-    // initialize tracking queue
-    std::queue<IndexType> visitQueue;
-    unsigned int stepCount = 1;
-    const double minFA = 0.5;
-    const unsigned int maxSteps = 20000;
-    const double stepSize = 1;
-	
-    itk::ImageRegionIterator<LabelImageType> labelIt(labelImage, region);
-    for (labelIt.GoToBegin(); !labelIt.IsAtEnd(); ++labelIt) {
-        if (labelIt.Get() == 1) {
-            IndexType seedIndex = labelIt.GetIndex();
-            visitQueue.push(seedIndex);
-            outputImage->SetPixel(seedIndex, stepCount);
+    // read active voxel mask
+    std::unique_ptr<ActiveVoxelMask> activeMask;
+    if (!maskPath.empty()) {
+        activeMask.reset(new ActiveVoxelMask(ActiveVoxelMask::load(maskPath)));
+        const uint64_t dims[3] = {region.GetSize(0), region.GetSize(1), region.GetSize(2)};
+        if (!activeMask->matches(dims)) {
+            throw std::runtime_error("Mask does not match FA image: " + maskPath);
         }
     }
 
-    // Algorithm
-    while (!visitQueue.empty() && stepCount < maxSteps) {
-        IndexType currentIndex = visitQueue.front();
-        visitQueue.pop();
-		
-        if (faImage->GetPixel(currentIndex) < minFA) continue;
-
-        VectorType principalEigenvector = eigenvectorImage->GetPixel(currentIndex);
-
-        for (int sign : {1, -1}) {
-            IndexType nextIndex = currentIndex;
-            for (unsigned int i = 0; i < 3; ++i) {
-                nextIndex[i] += sign * static_cast<int>(std::round(principalEigenvector[i] * stepSize));
-            }
-
-            if (region.IsInside(nextIndex) && outputImage->GetPixel(nextIndex) == 0 &&
-                faImage->GetPixel(nextIndex) >= minFA) {
-                visitQueue.push(nextIndex);
-                outputImage->SetPixel(nextIndex, ++stepCount);
+    // seeds, in voxel order
+    const uint64_t dims[3] = {region.GetSize(0), region.GetSize(1), region.GetSize(2)};
+    const LabelImageType::PixelType *labels = labelImage->GetBufferPointer();
+    std::vector<uint64_t> seeds;
+    if (activeMask) {
+        // seeds can only sit in active voxels, so only those runs are scanned
+        for (const auto &run : activeMask->runs()) {
+            for (uint64_t voxel = run.start; voxel < run.start + run.length; ++voxel) {
+                if (labels[voxel] == 1) seeds.push_back(voxel);
             }
         }
+    } else {
+        const uint64_t voxelCount = dims[0] * dims[1] * dims[2];
+        for (uint64_t voxel = 0; voxel < voxelCount; ++voxel) {
+            if (labels[voxel] == 1) seeds.push_back(voxel);
+        }
     }
 
+    // Algorithm: parallel BFS over the raw buffers, one frontier level at a time
+    static_assert(sizeof(VectorType) == 3 * sizeof(double), "e1 buffer must be packed xyz doubles");
+    VoxelBFSParameters params;
+    params.minFA = 0.5;
+    params.stepSize = 1;
+    const uint64_t stepCount = RunVoxelBFS(faImage->GetBufferPointer(),
+                                           reinterpret_cast<const double *>(eigenvectorImage->GetBufferPointer()),
+                                           dims, seeds, activeMask.get(), params, outputImage->GetBufferPointer());
+
     std::cout << "TractographyLabeled completed. Steps taken: " << stepCount << std::endl;
+    RunMetrics::add(MetricCounter::VoxelsProcessed, stepCount);
 
     // save
     auto writer = itk::ImageFileWriter<OutputImageType>::New();
@@ -3,6 +3,7 @@
 
 #include <string>
 
-void PerformTractographyLabeled(const std::string &tensorImagePath, const std::string &faImagePath, const std::string &labelImagePath, const std::string &eigenvectorImagePath, const std::string &outputImagePath);
+// maskPath: optional ActiveVoxelMask; seeds are searched and voxels visited only inside it.
+void PerformTractographyLabeled(const std::string &tensorImagePath, const std::string &faImagePath, const std::string &labelImagePath, const std::string &eigenvectorImagePath, const std::string &outputImagePath, const std::string &maskPath = "");
 
 #endif
@@ -1,11 +1,14 @@
 #include "TractographySingleVoxel.h"
+#include "RunMetrics.h"
+#include "VoxelBFS.h"
 #include <itkImageFileReader.h>
 #include <itkImageFileWriter.h>
 #include <itkDiffusionTensor3D.h>
 #include <itkVector.h>
 #include <itkImage.h>
-#include <queue>
 #include <iostream>
+#include <stdexcept>
+#include <vector>
 
 using PixelType = itk::DiffusionTensor3D<double>;
 using ImageType = itk::Image<PixelType, 3>;
@@ -18,6 +21,7 @@ using IndexType = ImageType::IndexType;
 void PerformTractographySingleVoxel(const std::string &tensorImagePath, const std::string &faImagePath, const std::string &eigenvectorImagePath, const std::string &outputImagePath)
 {
     std::cout << "Task started: Tractography - Single Voxel" << std::endl;
+    StageTimer timer("voxel_bfs_single");
 	
 	// read principal eigenvector image
     auto eigenvectorReader = itk::ImageFileReader<VectorImageType>::New();
@@ -34,6 +38,14 @@ void PerformTractographySingleVoxel(const std::string &tensorImagePath, const st
     VectorImageType::Pointer eigenvectorImage = eigenvectorReader->GetOutput();
     FAImageType::RegionType region = faImage->GetLargestPossibleRegion();
 
+    // the BFS indexes both buffers by FA voxel: each image must be FA's grid, whole
+    if (faImage->GetBufferedRegion() != region) {
+        throw std::runtime_error("FA image not fully buffered: " + faImagePath);
+    }
+    if (eigenvectorImage->GetLargestPossibleRegion() != region || eigenvectorImage->GetBufferedRegion() != region) {
+        throw std::runtime_error("Eigenvector image does not match FA image: " + eigenvectorImagePath);
+    }
+
     // initialize output image
     OutputImageType::Pointer outputImage = OutputImageType::New();
     outputImage->SetRegions(region);
@@ -43,41 +55,25 @@ void PerformTractographySingleVoxel(const std::string &tensorImagePath, const st
     outputImage->Allocate();
     outputImage->FillBuffer(0);
 
-    // initialize tracking queue
+    // seed point
     IndexType seedIndex = {{72, 70, 34}};
-    std::queue<IndexType> visitQueue;
-    visitQueue.push(seedIndex);
-    unsigned int stepCount = 1;
-    const double minFA = 0.5;
-    const unsigned int maxSteps = 20000;
-    const double stepSize = 2;
-
-    outputImage->SetPixel(seedIndex, stepCount); // set seed point
-
-    // Algorithm
-    while (!visitQueue.empty() && stepCount < maxSteps) {
-        IndexType currentIndex = visitQueue.front();
-        visitQueue.pop();
-
-        if (faImage->GetPixel(currentIndex) < minFA) continue;
-
-        VectorType principalEigenvector = eigenvectorImage->GetPixel(currentIndex);
-
-        for (int sign : {1, -1}) {
-            IndexType nextIndex = currentIndex;
-            for (unsigned int i = 0; i < 3; ++i) {
-                nextIndex[i] += sign * static_cast<int>(std::round(principalEigenvector[i] * stepSize));
-            }
-
-            if (region.IsInside(nextIndex) && outputImage->GetPixel(nextIndex) == 0 &&
-                faImage->GetPixel(nextIndex) >= minFA) {
-                visitQueue.push(nextIndex);
-                outputImage->SetPixel(nextIndex, ++stepCount);
-            }
-        }
+    if (!region.IsInside(seedIndex)) {
+        throw std::runtime_error("Seed point outside the FA image");
     }
+    const uint64_t dims[3] = {region.GetSize(0), region.GetSize(1), region.GetSize(2)};
+    const std::vector<uint64_t> seeds = {static_cast<uint64_t>(faImage->ComputeOffset(seedIndex))};
+
+    // Algorithm: parallel BFS over the raw buffers, one frontier level at a time
+    static_assert(sizeof(VectorType) == 3 * sizeof(double), "e1 buffer must be packed xyz doubles");
+    VoxelBFSParameters params;
+    params.minFA = 0.5;
+    params.stepSize = 2;
+    const uint64_t stepCount = RunVoxelBFS(faImage->GetBufferPointer(),
+                                           reinterpret_cast<const double *>(eigenvectorImage->GetBufferPointer()),
+                                           dims, seeds, nullptr, params, outputImage->GetBufferPointer());
 
     std::cout << "TractographySingle completed. Steps taken: " << stepCount << std::endl;
+    RunMetrics::add(MetricCounter::VoxelsProcessed, stepCount);
 
     // save
     auto writer = itk::ImageFileWriter<OutputImageType>::New();
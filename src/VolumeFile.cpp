@@ -0,0 +1,163 @@
+#include "VolumeFile.h"
+#include <cstring>
+#include <limits>
+#include <fstream>
+#include <stdexcept>
+
+namespace {
+
+const char VOLUME_MAGIC[8] = {'D', 'T', 'I', 'V', 'O', 'L', '\0', '\0'};
+const uint32_t VOLUME_VERSION = 1;
+
+}
+
+size_t volumeDataTypeSize(VolumeDataType dataType) {
+    switch (dataType) {
+        case VolumeDataType::Float32: return 4;
+        case VolumeDataType::Float64: return 8;
+        case VolumeDataType::UInt8: return 1;
+        case VolumeDataType::UInt16: return 2;
+    }
+    return 0;
+}
+
+VolumeHeader makeVolumeHeader(const uint64_t dimensions[3], uint32_t components,
+                              VolumeDataType dataType, VolumeLayout layout) {
+    VolumeHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, VOLUME_MAGIC, sizeof(header.magic));
+    header.version = VOLUME_VERSION;
+    header.headerSize = sizeof(VolumeHeader);
+    for (int i = 0; i < 3; i++) {
+        header.dimensions[i] = dimensions[i];
+    }
+    header.components = components;
+    header.dataType = dataType;
+    header.layout = layout;
+
+    // identity: voxel index == world coordinate
+    for (int i = 0; i < 4; i++) {
+        header.voxelToWorld[i * 4 + i] = 1.0;
+    }
+
+    header.payloadOffset = sizeof(VolumeHeader);
+    header.payloadBytes = volumePayloadBytes(header);
+    return header;
+}
+
+void setVoxelToWorld(VolumeHeader& header, const double spacing[3], const double origin[3],
+                     const double direction[9]) {
+    for (int row = 0; row < 3; row++) {
+        for (int col = 0; col < 3; col++) {
+            header.voxelToWorld[row * 4 + col] = direction[row * 3 + col] * spacing[col];
+        }
+        header.voxelToWorld[row * 4 + 3] = origin[row];
+    }
+    header.voxelToWorld[12] = 0.0;
+    header.voxelToWorld[13] = 0.0;
+    header.voxelToWorld[14] = 0.0;
+    header.voxelToWorld[15] = 1.0;
+}
+
+uint64_t volumeVoxelCount(const VolumeHeader& header) {
+    return header.dimensions[0] * header.dimensions[1] * header.dimensions[2];
+}
+
+uint64_t volumeRecordCount(const VolumeHeader& header) {
+    if (header.layout == VolumeLayout::Bricked8) {
+        const uint64_t* dims = header.dimensions;
+        return ((dims[0] + 7) & ~uint64_t(7)) * ((dims[1] + 7) & ~uint64_t(7)) * ((dims[2] + 7) & ~uint64_t(7));
+    }
+    return volumeVoxelCount(header);
+}
+
+uint64_t volumePayloadBytes(const VolumeHeader& header) {
+    return volumeRecordCount(header) * header.components * volumeDataTypeSize(header.dataType);
+}
+
+void volumeStrides(const VolumeHeader& header, uint64_t strides[3]) {
+    const uint64_t* dims = header.dimensions;
+    if (header.layout == VolumeLayout::XMajor) {
+        strides[0] = dims[1] * dims[2];
+        strides[1] = dims[2];
+        strides[2] = 1;
+    } else {
+        strides[0] = 1;
+        strides[1] = dims[0];
+        strides[2] = dims[0] * dims[1];
+    }
+}
+
+bool readVolumeHeader(const void* data, size_t size, VolumeHeader& header) {
+    if (size < sizeof(VolumeHeader)) {
+        return false;
+    }
+    std::memcpy(&header, data, sizeof(VolumeHeader));
+    if (std::memcmp(header.magic, VOLUME_MAGIC, sizeof(header.magic)) != 0) {
+        return false;
+    }
+    if (header.version != VOLUME_VERSION || header.headerSize != sizeof(VolumeHeader) ||
+        volumeDataTypeSize(header.dataType) == 0 ||
+        static_cast<uint32_t>(header.layout) > static_cast<uint32_t>(VolumeLayout::Bricked8)) {
+        return false;
+    }
+    // the sizes come from the file: compare them without sums or products that could wrap
+    const uint64_t maxBytes = std::numeric_limits<uint64_t>::max();
+    uint64_t records = 1;
+    for (int i = 0; i < 3; i++) {
+        // padded to whole bricks, which bounds the linear layouts too
+        const uint64_t extent = (header.dimensions[i] + 7) & ~uint64_t(7);
+        if (extent < header.dimensions[i] || (extent != 0 && records > maxBytes / extent)) {
+            return false;
+        }
+        records *= extent;
+    }
+    const uint64_t elementBytes = header.components * volumeDataTypeSize(header.dataType);
+    if (elementBytes != 0 && records > maxBytes / elementBytes) {
+        return false;
+    }
+    if (header.payloadBytes != volumePayloadBytes(header) || header.payloadOffset > size ||
+        header.payloadBytes > size - header.payloadOffset) {
+        return false;
+    }
+    return true;
+}
+
+void writeVolumeFile(const std::string& path, const VolumeHeader& header, const void* payload) {
+    std::ofstream out(path, std::ios::binary);
+    if (!out) {
+        throw std::runtime_error("Cannot write " + path);
+    }
+    out.write(reinterpret_cast<const char*>(&header), sizeof(VolumeHeader));
+    out.seekp(static_cast<std::streamoff>(header.payloadOffset));
+    out.write(static_cast<const char*>(payload), static_cast<std::streamsize>(header.payloadBytes));
+    if (!out) {
+        throw std::runtime_error("Failed writing " + path);
+    }
+}
+
+VolumeFileWriter::VolumeFileWriter(const std::string& filePath, const VolumeHeader& volumeHeader)
+    : out(filePath, std::ios::binary | std::ios::trunc), header(volumeHeader),
+      voxelBytes(volumeHeader.components * volumeDataTypeSize(volumeHeader.dataType)), path(filePath) {
+    if (!out) {
+        throw std::runtime_error("Cannot write " + path);
+    }
+    out.write(reinterpret_cast<const char*>(&header), sizeof(VolumeHeader));
+}
+
+void VolumeFileWriter::writeVoxels(uint64_t firstVoxel, const void* data, uint64_t voxelCount) {
+    if (firstVoxel + voxelCount > volumeRecordCount(header)) {
+        throw std::runtime_error("Voxel range outside volume: " + path);
+    }
+    out.seekp(static_cast<std::streamoff>(header.payloadOffset + firstVoxel * voxelBytes));
+    out.write(static_cast<const char*>(data), static_cast<std::streamsize>(voxelCount * voxelBytes));
+    if (!out) {
+        throw std::runtime_error("Failed writing " + path);
+    }
+}
+
+void VolumeFileWriter::close() {
+    if (out.is_open()) {
+        out.close();
+    }
+}
\ No newline at end of file
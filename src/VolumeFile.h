@@ -0,0 +1,82 @@
+#ifndef VOLUME_FILE_H
+#define VOLUME_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+// Binary volume container: a fixed 256-byte header followed by the raw payload.
+// The header records shape, element type, memory layout and the voxel-to-world
+// transform, so readers never need hard-coded dimensions or a transposition.
+// All integers are little-endian and all indexing is 64-bit.
+
+enum class VolumeLayout : uint32_t {
+    XFastest = 0,   // ITK/VTK order: index = x + nx * (y + ny * z)
+    XMajor = 1,     // legacy .bin order: index = z + nz * (y + ny * x)
+    Bricked8 = 2    // 8x8x8 bricks (BrickedLayout<8>), each axis padded to a multiple of 8
+};
+
+enum class VolumeDataType : uint32_t {
+    Float32 = 0,
+    Float64 = 1,
+    UInt8 = 2,
+    UInt16 = 3
+};
+
+struct VolumeHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint64_t dimensions[3];
+    uint32_t components;
+    VolumeDataType dataType;
+    VolumeLayout layout;
+    uint32_t reserved0;
+    double voxelToWorld[16];    // row-major 4x4, world = M * (i, j, k, 1)
+    uint64_t payloadOffset;
+    uint64_t payloadBytes;
+    uint8_t reserved[56];
+};
+
+static_assert(sizeof(VolumeHeader) == 256, "VolumeHeader must stay 256 bytes");
+
+// Shape of the headerless eigenvector_data.bin files written before the container existed.
+const uint64_t LEGACY_VOLUME_DIMENSIONS[3] = {144, 144, 85};
+
+size_t volumeDataTypeSize(VolumeDataType dataType);
+
+VolumeHeader makeVolumeHeader(const uint64_t dimensions[3], uint32_t components,
+                              VolumeDataType dataType, VolumeLayout layout);
+void setVoxelToWorld(VolumeHeader& header, const double spacing[3], const double origin[3],
+                     const double direction[9]);
+
+uint64_t volumeVoxelCount(const VolumeHeader& header);
+// Records stored in the payload, including any brick padding.
+uint64_t volumeRecordCount(const VolumeHeader& header);
+uint64_t volumePayloadBytes(const VolumeHeader& header);
+
+// Per-axis voxel strides for the linear layouts (XFastest, XMajor).
+void volumeStrides(const VolumeHeader& header, uint64_t strides[3]);
+
+// Returns false if data does not start with a valid container header.
+bool readVolumeHeader(const void* data, size_t size, VolumeHeader& header);
+
+void writeVolumeFile(const std::string& path, const VolumeHeader& header, const void* payload);
+
+// Writes a container piece by piece, e.g. one slab of slices at a time.
+// Voxels are addressed in the header's layout order.
+class VolumeFileWriter {
+private:
+    std::ofstream out;
+    VolumeHeader header;
+    size_t voxelBytes;
+    std::string path;
+
+public:
+    VolumeFileWriter(const std::string& path, const VolumeHeader& header);
+    void writeVoxels(uint64_t firstVoxel, const void* data, uint64_t voxelCount);
+    void close();
+};
+
+#endif // VOLUME_FILE_H
\ No newline at end of file
@@ -1,25 +1,66 @@
 #include "VolumeRenderer.h"
-#include <vtkNrrdReader.h>
-#include <vtkVolumeProperty.h>
+#include "VolumeStore.h"
 #include <vtkColorTransferFunction.h>
-#include <vtkPiecewiseFunction.h>
-#include <vtkSmartVolumeMapper.h>
-#include <vtkImageData.h>
+#include <vtkImageShrink3D.h>
+#include <algorithm>
+#include <thread>
 
-VolumeRenderer::VolumeRenderer(const char* fname) : filename(fname) {
+namespace {
+
+// shrink factor of each pyramid level, finest first
+const int PYRAMID_SHRINK[] = {1, 2, 4};
+// opacity lookup bins over the FA range when looking for visible voxels
+const int OPACITY_BINS = 1024;
+
+int threadsOrCores(int threads) {
+    return threads > 0 ? threads : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+}
+
+// Widens low/high (index space) to the voxels whose opacity bin is not zero.
+// scalars points at the first voxel of the extent, first component.
+template <class T>
+void growVisibleBox(const T* scalars, int components, const int* extent, const double* opacity,
+                    double rangeMin, double binScale, int low[3], int high[3]) {
+    for (int z = extent[4]; z <= extent[5]; z++) {
+        for (int y = extent[2]; y <= extent[3]; y++) {
+            int first = extent[1] + 1;
+            int last = extent[0] - 1;
+            for (int x = extent[0]; x <= extent[1]; x++, scalars += components) {
+                const double value = static_cast<double>(*scalars);
+                const int bin = std::min(OPACITY_BINS - 1, std::max(0, static_cast<int>((value - rangeMin) * binScale + 0.5)));
+                if (opacity[bin] > 0.0) {
+                    first = std::min(first, x);
+                    last = x;
+                }
+            }
+            if (last < first) {
+                continue;
+            }
+            low[0] = std::min(low[0], first);
+            low[1] = std::min(low[1], y);
+            low[2] = std::min(low[2], z);
+            high[0] = std::max(high[0], last);
+            high[1] = std::max(high[1], y);
+            high[2] = std::max(high[2], z);
+        }
+    }
+}
+
+}
+
+VolumeRenderer::VolumeRenderer(const char* fname)
+    : filename(fname), cropping(false), rayCastThreads(0) {
     SetupTransferFunctions();
     SetupVolume();
     SetupRenderer();
 }
 
 void VolumeRenderer::SetupTransferFunctions() {
-    vtkSmartPointer<vtkNrrdReader> reader = vtkSmartPointer<vtkNrrdReader>::New();
-    reader->SetFileName(filename);
-    reader->Update();
-    reader->GetOutput()->GetScalarRange(scalarRange);
+    // shared with the trackers, and resolves subjects registered in memory
+    faImage = VolumeStore::openFAImage(filename);
+    faImage->GetScalarRange(scalarRange);
 
-    vtkSmartPointer<vtkPiecewiseFunction> opacityTransferFunction = 
-        vtkSmartPointer<vtkPiecewiseFunction>::New();
+    opacityTransferFunction = vtkSmartPointer<vtkPiecewiseFunction>::New();
     opacityTransferFunction->AddPoint(scalarRange[0], 0.0);
     opacityTransferFunction->AddPoint(scalarRange[1], 1.0);
 
@@ -28,23 +69,123 @@ void VolumeRenderer::SetupTransferFunctions() {
     colorTransferFunction->AddRGBPoint(scalarRange[0], 0.0, 0.0, 0.0);
     colorTransferFunction->AddRGBPoint(scalarRange[1], 1.0, 1.0, 1.0);
 
-    vtkSmartPointer<vtkVolumeProperty> volumeProperty = 
-        vtkSmartPointer<vtkVolumeProperty>::New();
-    volumeProperty->SetColor(colorTransferFunction);
-    volumeProperty->SetScalarOpacity(opacityTransferFunction);
-    volumeProperty->SetInterpolationTypeToLinear();
-    volumeProperty->ShadeOn();
+    stillProperty = vtkSmartPointer<vtkVolumeProperty>::New();
+    stillProperty->SetColor(colorTransferFunction);
+    stillProperty->SetScalarOpacity(opacityTransferFunction);
+    stillProperty->SetInterpolationTypeToLinear();
+    stillProperty->ShadeOn();
+
+    // shading is most of a CPU ray-cast frame; moving views go without it
+    interactiveProperty = vtkSmartPointer<vtkVolumeProperty>::New();
+    interactiveProperty->SetColor(colorTransferFunction);
+    interactiveProperty->SetScalarOpacity(opacityTransferFunction);
+    interactiveProperty->SetInterpolationTypeToLinear();
+    interactiveProperty->ShadeOff();
+
+    FindVisibleBox();
+}
+
+// Crops rays to the voxels the opacity transfer function does not make fully
+// transparent (plus one voxel), so the background around the brain costs nothing.
+void VolumeRenderer::FindVisibleBox() {
+    double opacity[OPACITY_BINS];
+    opacityTransferFunction->GetTable(scalarRange[0], scalarRange[1], OPACITY_BINS, opacity);
+    const double binScale = scalarRange[1] > scalarRange[0] ? (OPACITY_BINS - 1) / (scalarRange[1] - scalarRange[0]) : 0.0;
+
+    const int* extent = faImage->GetExtent();
+    int low[3] = {extent[1] + 1, extent[3] + 1, extent[5] + 1};
+    int high[3] = {extent[0] - 1, extent[2] - 1, extent[4] - 1};
+    void* scalars = faImage->GetScalarPointer(extent[0], extent[2], extent[4]);
+    const int components = faImage->GetNumberOfScalarComponents();
+    switch (faImage->GetScalarType()) {
+        vtkTemplateMacro(growVisibleBox(static_cast<const VTK_TT*>(scalars), components, extent, opacity,
+                                        scalarRange[0], binScale, low, high));
+    }
+
+    cropping = false;
+    if (high[0] < low[0]) {
+        return;     // nothing visible: let the mapper find that out
+    }
+    int first[3];
+    int last[3];
+    for (int axis = 0; axis < 3; axis++) {
+        first[axis] = std::max(extent[2 * axis], low[axis] - 1);
+        last[axis] = std::min(extent[2 * axis + 1], high[axis] + 1);
+        cropping = cropping || first[axis] > extent[2 * axis] || last[axis] < extent[2 * axis + 1];
+    }
+    // the mapper takes the planes back to index space through the image's
+    // direction matrix one corner at a time, so the box's two corners go out
+    // through it the same way
+    double firstCorner[3];
+    double lastCorner[3];
+    faImage->TransformIndexToPhysicalPoint(first[0], first[1], first[2], firstCorner);
+    faImage->TransformIndexToPhysicalPoint(last[0], last[1], last[2], lastCorner);
+    for (int axis = 0; axis < 3; axis++) {
+        croppingPlanes[2 * axis] = firstCorner[axis];
+        croppingPlanes[2 * axis + 1] = lastCorner[axis];
+    }
+}
 
-    vtkSmartPointer<vtkSmartVolumeMapper> volumeMapper = 
-        vtkSmartPointer<vtkSmartVolumeMapper>::New();
-    volumeMapper->SetInputConnection(reader->GetOutputPort());
+void VolumeRenderer::AddPyramidLevel(vtkImageData* image, int shrink, vtkVolumeProperty* property) {
+    auto mapper = vtkSmartPointer<vtkFixedPointVolumeRayCastMapper>::New();
+    mapper->SetInputData(image);
+    mapper->SetNumberOfThreads(threadsOrCores(rayCastThreads));
 
-    volume = vtkSmartPointer<vtkVolume>::New();
-    volume->SetMapper(volumeMapper);
-    volume->SetProperty(volumeProperty);
+    // half a voxel of this level along each ray; up to 4x4 pixels per ray
+    // when the frame time runs short
+    const double* spacing = faImage->GetSpacing();
+    const double voxel = std::min(spacing[0], std::min(spacing[1], spacing[2])) * shrink;
+    mapper->SetSampleDistance(static_cast<float>(0.5 * voxel));
+    mapper->SetInteractiveSampleDistance(static_cast<float>(voxel));
+    mapper->SetAutoAdjustSampleDistances(1);
+    mapper->SetMinimumImageSampleDistance(1.0f);
+    mapper->SetMaximumImageSampleDistance(4.0f);
+
+    if (cropping) {
+        mapper->SetCroppingRegionPlanes(croppingPlanes);
+        mapper->SetCroppingRegionFlagsToSubVolume();
+        mapper->CroppingOn();
+    }
+
+    // no time estimate: each level is timed on its first frame; lower level = finer
+    int id = volume->AddLOD(mapper, property, 0.0);
+    volume->SetLODLevel(id, static_cast<double>(mappers.size()));
+    mappers.push_back(mapper);
+}
+
+void VolumeRenderer::SetRayCastThreads(int threads) {
+    rayCastThreads = threads;
+    for (auto& mapper : mappers) {
+        mapper->SetNumberOfThreads(threadsOrCores(rayCastThreads));
+    }
 }
 
 void VolumeRenderer::SetupVolume() {
+    volume = vtkSmartPointer<vtkLODProp3D>::New();
+    for (int shrink : PYRAMID_SHRINK) {
+        if (shrink == 1) {
+            AddPyramidLevel(faImage, shrink, stillProperty);
+            continue;
+        }
+        // block averages, so thin bright tracts fade rather than vanish
+        auto shrinkFilter = vtkSmartPointer<vtkImageShrink3D>::New();
+        shrinkFilter->SetInputData(faImage);
+        shrinkFilter->SetShrinkFactors(shrink, shrink, shrink);
+        shrinkFilter->AveragingOn();
+        shrinkFilter->Update();
+        auto level = vtkSmartPointer<vtkImageData>::New();
+        level->ShallowCopy(shrinkFilter->GetOutput());
+        // the filter keeps the input origin, but a level voxel averages the
+        // block starting there: centre it on the block, (shrink - 1) / 2 voxels
+        // in, so the view does not jump when the LOD changes
+        const double blockCentre = 0.5 * (shrink - 1);
+        double levelOrigin[3];
+        faImage->TransformContinuousIndexToPhysicalPoint(blockCentre, blockCentre, blockCentre, levelOrigin);
+        level->SetOrigin(levelOrigin);
+        AddPyramidLevel(level, shrink, interactiveProperty);
+    }
+    volume->AutomaticLODSelectionOn();
+
     renderer = vtkSmartPointer<vtkRenderer>::New();
     renderWindow = vtkSmartPointer<vtkRenderWindow>::New();
     renderWindow->AddRenderer(renderer);
@@ -52,6 +193,9 @@ void VolumeRenderer::SetupVolume() {
 
     renderWindowInteractor = vtkSmartPointer<vtkRenderWindowInteractor>::New();
     renderWindowInteractor->SetRenderWindow(renderWindow);
+    // frame rate while rotating; at rest the still rate leaves time for full resolution
+    renderWindowInteractor->SetDesiredUpdateRate(15.0);
+    renderWindowInteractor->SetStillUpdateRate(0.001);
 }
 
 void VolumeRenderer::SetupRenderer() {
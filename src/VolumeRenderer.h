@@ -2,27 +2,53 @@
 #define VOLUME_RENDERER_H
 
 #include <vtkSmartPointer.h>
-#include <vtkVolume.h>
+#include <vtkImageData.h>
+#include <vtkLODProp3D.h>
+#include <vtkVolumeProperty.h>
+#include <vtkPiecewiseFunction.h>
+#include <vtkFixedPointVolumeRayCastMapper.h>
 #include <vtkRenderer.h>
 #include <vtkRenderWindow.h>
 #include <vtkRenderWindowInteractor.h>
+#include <vector>
 
+// FA volume rendering sized for CPU-only hosts.
+// The FA image is drawn from a pyramid (full, 1/2 and 1/4 resolution) held
+// in one vtkLODProp3D: while the view moves the interactor asks for 15 fps and
+// the prop picks the finest level whose measured ray-cast time fits, the
+// coarse levels without shading; at rest it draws full resolution, shaded.
+// Each level's ray caster also widens its image sample distance when its
+// frame time runs out, skips empty blocks through its min/max space leaping
+// against the opacity transfer function, and is cropped to the box of voxels
+// that transfer function leaves visible.
 class VolumeRenderer {
 public:
     VolumeRenderer(const char* filename);
+    // threads per ray-cast frame; 0 (the default) is one per core
+    void SetRayCastThreads(int threads);
     void Render();
 
 private:
     void SetupTransferFunctions();
     void SetupVolume();
     void SetupRenderer();
+    void FindVisibleBox();
+    void AddPyramidLevel(vtkImageData* image, int shrink, vtkVolumeProperty* property);
 
-    vtkSmartPointer<vtkVolume> volume;
+    vtkSmartPointer<vtkImageData> faImage;
+    vtkSmartPointer<vtkPiecewiseFunction> opacityTransferFunction;
+    vtkSmartPointer<vtkVolumeProperty> stillProperty;
+    vtkSmartPointer<vtkVolumeProperty> interactiveProperty;
+    vtkSmartPointer<vtkLODProp3D> volume;
+    std::vector<vtkSmartPointer<vtkFixedPointVolumeRayCastMapper>> mappers;
     vtkSmartPointer<vtkRenderer> renderer;
     vtkSmartPointer<vtkRenderWindow> renderWindow;
     vtkSmartPointer<vtkRenderWindowInteractor> renderWindowInteractor;
     const char* filename;
     double scalarRange[2];
+    double croppingPlanes[6];   // per axis, world coordinate of the visible box's first then last corner
+    bool cropping;
+    int rayCastThreads;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,273 @@
+#include "VolumeStore.h"
+#include <vtkNrrdReader.h>
+#include <vtkWeakPointer.h>
+#include <vtkPointData.h>
+#include <vtkDataArray.h>
+#include <algorithm>
+#include <map>
+#include <vector>
+#include <mutex>
+#include <stdexcept>
+#include <climits>
+#include <cstdlib>
+#include <unistd.h>
+
+namespace {
+
+std::mutex registryMutex;
+std::map<std::string, std::weak_ptr<const MappedFile>> vectorFiles;
+std::map<std::string, vtkWeakPointer<vtkImageData>> faImages;
+std::map<std::string, std::weak_ptr<const ActiveVoxelMask>> activeMasks;
+std::map<std::string, std::weak_ptr<const DirectionFAVolume>> directionFAVolumes;
+std::map<std::string, VectorVolume> memoryVectorVolumes;
+std::map<std::string, vtkSmartPointer<vtkImageData>> memoryFAImages;
+
+// element type of a Bricked8 container holding TrackingRecords
+struct RecordFormat {
+    uint32_t components;
+    VolumeDataType dataType;
+};
+
+RecordFormat recordFormat(const DirectionFAVoxel*) { return {4, VolumeDataType::Float32}; }
+RecordFormat recordFormat(const OctahedralVoxel16*) { return {3, VolumeDataType::UInt16}; }
+RecordFormat recordFormat(const OctahedralVoxel8*) { return {5, VolumeDataType::UInt8}; }
+
+const RecordFormat TRACKING_RECORD_FORMAT = recordFormat(static_cast<const TrackingRecord*>(nullptr));
+
+// same file reached through different relative paths must hit the same entry
+std::string canonicalPath(const std::string& path) {
+    char resolved[PATH_MAX];
+    if (realpath(path.c_str(), resolved)) {
+        return resolved;
+    }
+    return path;
+}
+
+}
+
+std::shared_ptr<const MappedFile> VolumeStore::openVectorFile(const std::string& path) {
+    std::string key = canonicalPath(path);
+    std::lock_guard<std::mutex> lock(registryMutex);
+
+    auto cached = vectorFiles[key].lock();
+    if (cached) {
+        return cached;
+    }
+
+    auto mapped = std::make_shared<const MappedFile>(key);
+    vectorFiles[key] = mapped;
+    return mapped;
+}
+
+VectorVolume VolumeStore::openVectorVolume(const std::string& path) {
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        auto registered = memoryVectorVolumes.find(path);
+        if (registered != memoryVectorVolumes.end()) {
+            return registered->second;
+        }
+    }
+
+    VectorVolume volume;
+    volume.file = openVectorFile(path);
+
+    if (!readVolumeHeader(volume.file->data(), volume.file->size(), volume.header)) {
+        volume.header = makeVolumeHeader(LEGACY_VOLUME_DIMENSIONS, 3, VolumeDataType::Float32, VolumeLayout::XMajor);
+        volume.header.payloadOffset = 0;
+        if (volume.file->size() < volume.header.payloadBytes) {
+            throw std::runtime_error("Eigenvector file too small: " + path);
+        }
+    }
+
+    if (volume.header.components != 3 || volume.header.dataType != VolumeDataType::Float32 ||
+        volume.header.layout == VolumeLayout::Bricked8) {
+        throw std::runtime_error("Expected a linear 3-component float32 volume: " + path);
+    }
+
+    volume.data = reinterpret_cast<const float*>(
+        static_cast<const char*>(volume.file->data()) + volume.header.payloadOffset);
+    for (int i = 0; i < 3; i++) {
+        volume.dimensions[i] = static_cast<int>(volume.header.dimensions[i]);
+    }
+    volumeStrides(volume.header, volume.strides);
+    return volume;
+}
+
+vtkSmartPointer<vtkImageData> VolumeStore::openFAImage(const std::string& path) {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    auto registered = memoryFAImages.find(path);
+    if (registered != memoryFAImages.end()) {
+        return registered->second;
+    }
+
+    std::string key = canonicalPath(path);
+
+    vtkSmartPointer<vtkImageData> cached = faImages[key].GetPointer();
+    if (cached) {
+        return cached;
+    }
+
+    auto faReader = vtkSmartPointer<vtkNrrdReader>::New();
+    faReader->SetFileName(key.c_str());
+    faReader->Update();
+    vtkSmartPointer<vtkImageData> faImage = faReader->GetOutput();
+    faImages[key] = faImage;
+    return faImage;
+}
+
+std::shared_ptr<const DirectionFAVolume> VolumeStore::openDirectionFAVolume(const std::string& vectorPath, const std::string& faPath) {
+    std::string key = canonicalPath(vectorPath) + "|" + canonicalPath(faPath);
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        auto cached = directionFAVolumes[key].lock();
+        if (cached) {
+            return cached;
+        }
+    }
+
+    bool inMemory;
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        inMemory = memoryVectorVolumes.count(vectorPath) != 0;
+    }
+
+    auto volume = std::make_shared<DirectionFAVolume>();
+    std::shared_ptr<const MappedFile> file = inMemory ? nullptr : openVectorFile(vectorPath);
+    VolumeHeader header;
+    if (file && readVolumeHeader(file->data(), file->size(), header) && header.layout == VolumeLayout::Bricked8) {
+        // already converted: records are used straight from the page cache
+        if (header.components != TRACKING_RECORD_FORMAT.components || header.dataType != TRACKING_RECORD_FORMAT.dataType) {
+            throw std::runtime_error("Tracking volume was written with a different record type: " + vectorPath);
+        }
+        volume->file = file;
+        volume->records = reinterpret_cast<const TrackingRecord*>(
+            static_cast<const char*>(file->data()) + header.payloadOffset);
+        for (int i = 0; i < 3; i++) {
+            volume->dimensions[i] = static_cast<int>(header.dimensions[i]);
+        }
+        std::copy(header.voxelToWorld, header.voxelToWorld + 16, volume->voxelToWorld);
+    } else {
+        VectorVolume vectors = openVectorVolume(vectorPath);
+        vtkSmartPointer<vtkImageData> faImage = openFAImage(faPath);
+        int* faDims = faImage->GetDimensions();
+        for (int i = 0; i < 3; i++) {
+            if (faDims[i] != vectors.dimensions[i]) {
+                throw std::runtime_error("FA image does not match eigenvector volume: " + faPath);
+            }
+            volume->dimensions[i] = vectors.dimensions[i];
+        }
+        std::copy(vectors.header.voxelToWorld, vectors.header.voxelToWorld + 16, volume->voxelToWorld);
+
+        // padding records stay zero, i.e. FA 0: never tracked into
+        TrackingLayout layout(volume->dimensions);
+        TrackingRecord background;
+        encodeVoxel(DirectionFAVoxel{{0.0f, 0.0f, 0.0f}, 0.0f}, background);
+        volume->storage.assign(TrackingLayout::recordCount(volume->dimensions), background);
+
+        // gather both inputs into records, whatever the vector file's layout
+        vtkDataArray* scalars = faImage->GetPointData()->GetScalars();
+        vtkIdType voxel = 0;
+        for (int z = 0; z < faDims[2]; z++) {
+            for (int y = 0; y < faDims[1]; y++) {
+                for (int x = 0; x < faDims[0]; x++, voxel++) {
+                    const float* vec = vectors.data + vectors.offset(x, y, z);
+                    DirectionFAVoxel record = {{vec[0], vec[1], vec[2]}, static_cast<float>(scalars->GetComponent(voxel, 0))};
+                    encodeVoxel(record, volume->storage[layout.index(x, y, z)]);
+                }
+            }
+        }
+        volume->records = volume->storage.data();
+    }
+
+    std::lock_guard<std::mutex> lock(registryMutex);
+    auto cached = directionFAVolumes[key].lock();
+    if (cached) {
+        return cached;
+    }
+    directionFAVolumes[key] = volume;
+    return volume;
+}
+
+void VolumeStore::writeTrackingVolume(const std::string& vectorPath, const std::string& faPath, const std::string& outputPath) {
+    auto volume = openDirectionFAVolume(vectorPath, faPath);
+
+    const uint64_t dims[3] = {static_cast<uint64_t>(volume->dimensions[0]), static_cast<uint64_t>(volume->dimensions[1]),
+                              static_cast<uint64_t>(volume->dimensions[2])};
+    VolumeHeader header = makeVolumeHeader(dims, TRACKING_RECORD_FORMAT.components, TRACKING_RECORD_FORMAT.dataType,
+                                           VolumeLayout::Bricked8);
+    std::copy(volume->voxelToWorld, volume->voxelToWorld + 16, header.voxelToWorld);
+    writeVolumeFile(outputPath, header, volume->records);
+}
+
+std::string VolumeStore::activeMaskPath(const std::string& volumePath) {
+    return canonicalPath(volumePath) + ".mask";
+}
+
+void VolumeStore::registerVectorVolume(const std::string& name, const VectorVolume& volume) {
+    if (volume.header.components != 3 || volume.header.dataType != VolumeDataType::Float32 ||
+        volume.header.layout == VolumeLayout::Bricked8) {
+        throw std::runtime_error("Expected a linear 3-component float32 volume: " + name);
+    }
+    std::lock_guard<std::mutex> lock(registryMutex);
+    memoryVectorVolumes[name] = volume;
+}
+
+void VolumeStore::registerFAImage(const std::string& name, vtkSmartPointer<vtkImageData> image) {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    memoryFAImages[name] = image;
+}
+
+void VolumeStore::release(const std::string& name) {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    memoryVectorVolumes.erase(name);
+    memoryFAImages.erase(name);
+    // a later registration under the same name must not be served what was built from this one
+    activeMasks.erase(activeMaskPath(name));
+    for (auto entry = directionFAVolumes.begin(); entry != directionFAVolumes.end();) {
+        size_t separator = entry->first.find('|');
+        if (entry->first.compare(0, separator, name) == 0 || entry->first.compare(separator + 1, std::string::npos, name) == 0) {
+            entry = directionFAVolumes.erase(entry);
+        } else {
+            entry++;
+        }
+    }
+}
+
+std::shared_ptr<const ActiveVoxelMask> VolumeStore::openActiveMask(const std::string& volumePath, const DirectionFAVolume& volume) {
+    std::string maskPath = activeMaskPath(volumePath);
+    std::lock_guard<std::mutex> lock(registryMutex);
+
+    auto cached = activeMasks[maskPath].lock();
+    if (cached) {
+        return cached;
+    }
+
+    const uint64_t dims[3] = {static_cast<uint64_t>(volume.dimensions[0]), static_cast<uint64_t>(volume.dimensions[1]),
+                              static_cast<uint64_t>(volume.dimensions[2])};
+
+    std::shared_ptr<const ActiveVoxelMask> mask;
+    if (access(maskPath.c_str(), R_OK) == 0) {
+        auto loaded = std::make_shared<ActiveVoxelMask>(ActiveVoxelMask::load(maskPath));
+        if (!loaded->matches(dims)) {
+            throw std::runtime_error("Mask does not match FA image: " + maskPath);
+        }
+        mask = loaded;
+    } else {
+        // no stored mask: everything with non-zero FA is brain
+        auto built = std::make_shared<ActiveVoxelMask>(dims);
+        TrackingSampler sampler = volume.sampler();
+        uint64_t voxel = 0;
+        for (int z = 0; z < volume.dimensions[2]; z++) {
+            for (int y = 0; y < volume.dimensions[1]; y++) {
+                for (int x = 0; x < volume.dimensions[0]; x++, voxel++) {
+                    float fa = decodeVoxel(sampler.at(x, y, z)).fa;
+                    built->appendValues(voxel, &fa, 1, 0.0f);
+                }
+            }
+        }
+        mask = built;
+    }
+
+    activeMasks[maskPath] = mask;
+    return mask;
+}
\ No newline at end of file
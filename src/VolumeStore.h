@@ -0,0 +1,76 @@
+#ifndef VOLUME_STORE_H
+#define VOLUME_STORE_H
+
+#include <vtkSmartPointer.h>
+#include <vtkImageData.h>
+#include "MappedFile.h"
+#include "VolumeFile.h"
+#include "ActiveVoxelMask.h"
+#include "VoxelSampler.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Zero-copy view of a 3-component float32 direction volume inside a mapped file,
+// or of an in-memory buffer kept alive by memory (see registerVectorVolume).
+struct VectorVolume {
+    std::shared_ptr<const MappedFile> file;
+    std::shared_ptr<const void> memory;
+    VolumeHeader header;
+    const float* data;
+    int dimensions[3];
+    uint64_t strides[3];
+
+    // index of the first component of voxel (x, y, z)
+    uint64_t offset(int x, int y, int z) const {
+        return (x * strides[0] + y * strides[1] + z * strides[2]) * 3;
+    }
+};
+
+// Direction and FA interleaved into one TrackingRecord per voxel for the trackers, in TrackingLayout order.
+// Records either live in a mapped Bricked8 container (file) or were built at load time (storage).
+struct DirectionFAVolume {
+    std::shared_ptr<const MappedFile> file;
+    std::vector<TrackingRecord> storage;
+    const TrackingRecord* records;
+    int dimensions[3];
+    double voxelToWorld[16];
+
+    TrackingSampler sampler() const {
+        return TrackingSampler(records, dimensions);
+    }
+};
+
+// Process-wide cache of the per-subject input volumes.
+// Opening the same file twice returns the same mapping/image; it is released
+// once the last tracker holding it goes away.
+// Volumes computed in memory can be registered under a name; every open* call
+// then resolves that name to the registered buffers instead of a file, until released.
+class VolumeStore {
+public:
+    static std::shared_ptr<const MappedFile> openVectorFile(const std::string& path);
+    // Accepts the VolumeFile container, or a headerless legacy x-major .bin.
+    static VectorVolume openVectorVolume(const std::string& path);
+    static vtkSmartPointer<vtkImageData> openFAImage(const std::string& path);
+    // One volume per subject, shared by every tracker, with direction and FA interleaved per voxel;
+    // the grid comes from the file header. Maps a Bricked8 tracking container directly (faPath is
+    // then unused), otherwise builds the records once per subject from the vector volume and the FA image.
+    static std::shared_ptr<const DirectionFAVolume> openDirectionFAVolume(const std::string& vectorPath, const std::string& faPath);
+    // Writes the tracking volume as a Bricked8 container, so later runs map it with no conversion.
+    // The container holds TrackingRecords, so it only maps into a build with the same record type.
+    static void writeTrackingVolume(const std::string& vectorPath, const std::string& faPath, const std::string& outputPath);
+    // Loads the mask stored next to the volume (activeMaskPath), or derives one from FA > 0.
+    static std::shared_ptr<const ActiveVoxelMask> openActiveMask(const std::string& volumePath, const DirectionFAVolume& volume);
+    // <volumePath>.mask, with volumePath resolved as openActiveMask resolves it
+    static std::string activeMaskPath(const std::string& volumePath);
+
+    // volume.data must stay valid while volume.memory is held; the store keeps a reference until release(name)
+    static void registerVectorVolume(const std::string& name, const VectorVolume& volume);
+    static void registerFAImage(const std::string& name, vtkSmartPointer<vtkImageData> image);
+    // drops the registered volumes; trackers already holding them keep them alive
+    static void release(const std::string& name);
+};
+
+#endif // VOLUME_STORE_H
\ No newline at end of file
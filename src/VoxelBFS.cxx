@@ -0,0 +1,115 @@
+#include "VoxelBFS.h"
+#include <itkMultiThreaderBase.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <memory>
+
+namespace
+{
+const size_t ChunkSize = 4096;
+
+// one bit per voxel; fetch_or tells the caller whether it won the voxel
+class VisitedBits
+{
+public:
+    explicit VisitedBits(uint64_t voxelCount) : words((voxelCount + 63) / 64), bits(new std::atomic<uint64_t>[(voxelCount + 63) / 64])
+    {
+        for (uint64_t i = 0; i < words; ++i) {
+            bits[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    bool Claim(uint64_t voxel)
+    {
+        const uint64_t bit = uint64_t(1) << (voxel & 63);
+        return (bits[voxel >> 6].fetch_or(bit, std::memory_order_relaxed) & bit) == 0;
+    }
+
+private:
+    uint64_t words;
+    std::unique_ptr<std::atomic<uint64_t>[]> bits;
+};
+}
+
+uint64_t RunVoxelBFS(const double *fa, const double *e1, const uint64_t dims[3], const std::vector<uint64_t> &seeds,
+                     const ActiveVoxelMask *mask, const VoxelBFSParameters &params, unsigned int *output)
+{
+    const uint64_t sliceVoxels = dims[0] * dims[1];
+    VisitedBits visited(sliceVoxels * dims[2]);
+
+    // level 0: the seeds, all numbered 1
+    std::vector<uint64_t> frontier;
+    frontier.reserve(seeds.size());
+    for (uint64_t seed : seeds) {
+        if (visited.Claim(seed)) {
+            frontier.push_back(seed);
+        }
+    }
+    std::sort(frontier.begin(), frontier.end());
+    for (uint64_t voxel : frontier) {
+        output[voxel] = 1;
+    }
+    uint64_t stepCount = frontier.empty() ? 0 : 1;
+    uint64_t visits = frontier.size();
+
+    auto threader = itk::MultiThreaderBase::New();
+    std::vector<std::vector<uint64_t>> claimed;
+
+    while (!frontier.empty() && (params.maxVisits == 0 || visits < params.maxVisits)) {
+        // chunks, not threads, own the partial results, so the split never depends on the thread count
+        const size_t numChunks = (frontier.size() + ChunkSize - 1) / ChunkSize;
+        claimed.assign(numChunks, std::vector<uint64_t>());
+
+        threader->ParallelizeArray(
+            0, numChunks,
+            [&](itk::SizeValueType chunk) {
+                std::vector<uint64_t> &found = claimed[chunk];
+                const size_t end = std::min(frontier.size(), (chunk + 1) * ChunkSize);
+                for (size_t f = chunk * ChunkSize; f < end; ++f) {
+                    const uint64_t voxel = frontier[f];
+                    if (fa[voxel] < params.minFA) continue;
+
+                    const int64_t x = static_cast<int64_t>(voxel % dims[0]);
+                    const int64_t y = static_cast<int64_t>((voxel / dims[0]) % dims[1]);
+                    const int64_t z = static_cast<int64_t>(voxel / sliceVoxels);
+                    const double *direction = e1 + voxel * 3;
+                    const int64_t step[3] = {static_cast<int64_t>(std::round(direction[0] * params.stepSize)),
+                                             static_cast<int64_t>(std::round(direction[1] * params.stepSize)),
+                                             static_cast<int64_t>(std::round(direction[2] * params.stepSize))};
+
+                    for (int sign : {1, -1}) {
+                        const int64_t nx = x + sign * step[0];
+                        const int64_t ny = y + sign * step[1];
+                        const int64_t nz = z + sign * step[2];
+                        if (nx < 0 || ny < 0 || nz < 0 || nx >= static_cast<int64_t>(dims[0]) ||
+                            ny >= static_cast<int64_t>(dims[1]) || nz >= static_cast<int64_t>(dims[2])) {
+                            continue;
+                        }
+                        const uint64_t next = static_cast<uint64_t>(nx) + dims[0] * (static_cast<uint64_t>(ny) + dims[1] * static_cast<uint64_t>(nz));
+                        if (fa[next] < params.minFA || (mask && !mask->test(next))) continue;
+                        if (visited.Claim(next)) {
+                            found.push_back(next);
+                        }
+                    }
+                }
+            },
+            nullptr);
+
+        frontier.clear();
+        for (const auto &found : claimed) {
+            frontier.insert(frontier.end(), found.begin(), found.end());
+        }
+        std::sort(frontier.begin(), frontier.end());
+        if (params.maxVisits != 0 && visits + frontier.size() > params.maxVisits) {
+            frontier.resize(params.maxVisits - visits);
+        }
+
+        for (uint64_t voxel : frontier) {
+            output[voxel] = static_cast<unsigned int>(++stepCount);
+        }
+        visits += frontier.size();
+    }
+
+    return stepCount;
+}
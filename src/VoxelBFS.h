@@ -0,0 +1,26 @@
+#ifndef VOXEL_BFS_H
+#define VOXEL_BFS_H
+
+#include "ActiveVoxelMask.h"
+#include <cstdint>
+#include <vector>
+
+struct VoxelBFSParameters {
+    double minFA = 0.5;
+    double stepSize = 1.0;
+    uint64_t maxVisits = 0; // 0: no cap
+};
+
+// Level-synchronous breadth-first voxel tracking over raw x-fastest buffers.
+// Each level's frontier is expanded across threads in fixed-size chunks; a voxel is
+// claimed by an atomic fetch-or on a visited bitset, so every voxel is reached once.
+// The next frontier is sorted by voxel index before numbering, so visit numbers are
+// deterministic per level for any thread count: all seeds get 1, then every level
+// continues the count in index order.
+// From each frontier voxel with FA >= minFA the step goes +-round(e1 * stepSize);
+// a target is taken if inside the volume, unvisited, active in mask (if any) and FA >= minFA.
+// Returns the highest visit number written, as the serial queue's stepCount did.
+uint64_t RunVoxelBFS(const double *fa, const double *e1, const uint64_t dims[3], const std::vector<uint64_t> &seeds,
+                     const ActiveVoxelMask *mask, const VoxelBFSParameters &params, unsigned int *output);
+
+#endif
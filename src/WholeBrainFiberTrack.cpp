@@ -0,0 +1,252 @@
+#include "WholeBrainFiberTrack.h"
+#include "TractogramIO.h"
+#include "StreamlineIndex.h"
+#include "RunMetrics.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <map>
+#include <mutex>
+#include <thread>
+
+namespace {
+
+const size_t SEEDS_PER_BATCH = 256;
+
+// splitmix64: tiny state, and every seed index gives an independent stream
+class SeedRandom {
+private:
+    uint64_t state;
+
+public:
+    explicit SeedRandom(uint64_t seed) : state(seed) {}
+
+    uint64_t next() {
+        uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+
+    // uniform in [0, 1)
+    double uniform() {
+        return (next() >> 11) * (1.0 / 9007199254740992.0);
+    }
+};
+
+// Hands traced batches to the writer in batch order. A worker may only run
+// `capacity` batches ahead of the writer, which bounds memory to capacity
+// batches however fast the workers are. Batches are claimed in increasing
+// order, so the batch the writer waits for is always inside the window.
+class OrderedBatchQueue {
+private:
+    std::mutex queueMutex;
+    std::condition_variable spaceFree;
+    std::condition_variable batchReady;
+    std::map<size_t, Tractogram> pending;
+    size_t nextBatch;
+    size_t capacity;
+    bool aborted;
+
+public:
+    explicit OrderedBatchQueue(size_t maxBatches) : nextBatch(0), capacity(std::max<size_t>(1, maxBatches)), aborted(false) {}
+
+    void push(size_t index, Tractogram&& batch) {
+        std::unique_lock<std::mutex> lock(queueMutex);
+        spaceFree.wait(lock, [&] { return aborted || index < nextBatch + capacity; });
+        if (aborted) {
+            return;
+        }
+        pending.emplace(index, std::move(batch));
+        RunMetrics::observeMax(MetricGauge::QueueHighWater, pending.size());
+        if (index == nextBatch) {
+            batchReady.notify_one();
+        }
+    }
+
+    // false once aborted
+    bool pop(Tractogram& batch) {
+        std::unique_lock<std::mutex> lock(queueMutex);
+        batchReady.wait(lock, [&] { return aborted || pending.count(nextBatch) != 0; });
+        if (aborted) {
+            return false;
+        }
+        auto found = pending.find(nextBatch);
+        batch = std::move(found->second);
+        pending.erase(found);
+        nextBatch++;
+        spaceFree.notify_all();
+        return true;
+    }
+
+    void abort() {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        aborted = true;
+        spaceFree.notify_all();
+        batchReady.notify_all();
+    }
+};
+
+}
+
+WholeBrainFiberTrack::WholeBrainFiberTrack(const char* vectorBinFile, const char* faFile)
+    : numThreads(std::max(1u, std::thread::hardware_concurrency())), seedsPerVoxel(1), seedMinFA(-1.0),
+      randomSeed(0), queueCapacity(0), writeIndex(false), streamlineCount(0), pointCount(0) {
+    volume = VolumeStore::openDirectionFAVolume(vectorBinFile, faFile);
+    activeMask = VolumeStore::openActiveMask(vectorBinFile, *volume);
+    integrator = StreamlineIntegrator(volume->sampler(), activeMask.get());
+}
+
+void WholeBrainFiberTrack::setParameters(double newAlpha, double newStepSize) {
+    StreamlineParameters params = integrator.getParameters();
+    params.minFA = newAlpha;
+    params.stepSize = newStepSize;
+    integrator.setParameters(params);
+}
+
+void WholeBrainFiberTrack::setStreamlineParameters(const StreamlineParameters& params) {
+    integrator.setParameters(params);
+}
+
+void WholeBrainFiberTrack::setNumberOfThreads(unsigned int newNumThreads) {
+    numThreads = newNumThreads > 0 ? newNumThreads : std::max(1u, std::thread::hardware_concurrency());
+}
+
+void WholeBrainFiberTrack::setSeedsPerVoxel(unsigned int count) {
+    seedsPerVoxel = std::max(1u, count);
+}
+
+void WholeBrainFiberTrack::setSeedFAThreshold(double minFA) {
+    seedMinFA = minFA;
+}
+
+void WholeBrainFiberTrack::setRandomSeed(uint64_t seed) {
+    randomSeed = seed;
+}
+
+void WholeBrainFiberTrack::setQueueCapacity(size_t batches) {
+    queueCapacity = batches;
+}
+
+void WholeBrainFiberTrack::setWriteIndex(bool enabled) {
+    writeIndex = enabled;
+}
+
+void WholeBrainFiberTrack::findSeedVoxels() {
+    const double threshold = seedMinFA >= 0.0 ? seedMinFA : integrator.getParameters().minFA;
+    const TrackingSampler sampler = volume->sampler();
+    const uint64_t* maskDims = activeMask->dimensions();
+
+    // mask runs are x-fastest, so seed voxels (and seed indices) follow the volume scan order
+    seedVoxels.clear();
+    for (const auto& run : activeMask->runs()) {
+        for (uint64_t voxel = run.start; voxel < run.start + run.length; voxel++) {
+            int x = static_cast<int>(voxel % maskDims[0]);
+            int y = static_cast<int>((voxel / maskDims[0]) % maskDims[1]);
+            int z = static_cast<int>(voxel / (maskDims[0] * maskDims[1]));
+            if (decodeVoxel(sampler.at(x, y, z)).fa >= threshold) {
+                seedVoxels.push_back({x, y, z});
+            }
+        }
+    }
+}
+
+uint64_t WholeBrainFiberTrack::seedCount() const {
+    return static_cast<uint64_t>(seedVoxels.size()) * seedsPerVoxel;
+}
+
+WholeBrainFiberTrack::Point WholeBrainFiberTrack::jitteredSeed(uint64_t seedIndex) const {
+    const std::array<int, 3>& voxel = seedVoxels[seedIndex / seedsPerVoxel];
+    SeedRandom random(randomSeed ^ (seedIndex * 0xd1342543de82ef95ULL));
+    // tracker coordinates: [i, i + 1) is voxel i
+    return {voxel[0] + random.uniform(), voxel[1] + random.uniform(), voxel[2] + random.uniform()};
+}
+
+void WholeBrainFiberTrack::traceAllFibers(const std::string& outputFile) {
+    StageTimer timer("whole_brain_tracking");
+    findSeedVoxels();
+    const uint64_t seeds = seedCount();
+    const size_t batchCount = static_cast<size_t>((seeds + SEEDS_PER_BATCH - 1) / SEEDS_PER_BATCH);
+    const unsigned int threadCount = static_cast<unsigned int>(
+        std::max<size_t>(1, std::min<size_t>(numThreads, batchCount)));
+
+    TractogramWriter writer(outputFile, makeTractogramHeader(volume->dimensions, volume->voxelToWorld));
+    OrderedBatchQueue queue(queueCapacity > 0 ? queueCapacity : threadCount * 4);
+    std::atomic<size_t> nextBatch(0);
+    std::exception_ptr failure;
+    std::mutex failureMutex;
+
+    auto fail = [&]() {
+        std::lock_guard<std::mutex> lock(failureMutex);
+        if (!failure) {
+            failure = std::current_exception();
+        }
+        queue.abort();
+    };
+
+    auto worker = [&]() {
+        try {
+            std::vector<Point> fiber;
+            for (;;) {
+                size_t batchIndex = nextBatch.fetch_add(1, std::memory_order_relaxed);
+                if (batchIndex >= batchCount) {
+                    break;
+                }
+                Tractogram batch;
+                uint64_t first = static_cast<uint64_t>(batchIndex) * SEEDS_PER_BATCH;
+                uint64_t last = std::min<uint64_t>(first + SEEDS_PER_BATCH, seeds);
+                for (uint64_t seedIndex = first; seedIndex < last; seedIndex++) {
+                    fiber.clear();
+                    integrator.trace(jitteredSeed(seedIndex), fiber);
+                    if (fiber.size() < 2) {
+                        continue;
+                    }
+                    batch.append(fiber.data(), fiber.size());
+                }
+                queue.push(batchIndex, std::move(batch));
+            }
+        } catch (...) {
+            fail();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(threadCount);
+    for (unsigned int t = 0; t < threadCount; t++) {
+        threads.emplace_back(worker);
+    }
+
+    // this thread is the writer, and indexes each batch in file order
+    std::unique_ptr<StreamlineIndexBuilder> indexBuilder;
+    if (writeIndex) {
+        indexBuilder.reset(new StreamlineIndexBuilder(volume->dimensions));
+    }
+    streamlineCount = 0;
+    pointCount = 0;
+    try {
+        Tractogram batch;
+        for (size_t written = 0; written < batchCount && queue.pop(batch); written++) {
+            writer.writeStreamlines(batch);
+            if (indexBuilder) {
+                indexBuilder->add(batch);
+            }
+            streamlineCount += batch.size();
+            pointCount += batch.pointCount();
+        }
+    } catch (...) {
+        fail();
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    if (failure) {
+        std::rethrow_exception(failure);
+    }
+    writer.close();
+    if (indexBuilder) {
+        StageTimer indexTimer("streamline_index");
+        indexBuilder->finish().save(streamlineIndexPath(outputFile));
+    }
+}
\ No newline at end of file
@@ -0,0 +1,61 @@
+#ifndef WHOLE_BRAIN_FIBER_TRACK_H
+#define WHOLE_BRAIN_FIBER_TRACK_H
+
+#include "VolumeStore.h"
+#include "StreamlineIntegrator.h"
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Whole-brain tractography for production runs.
+// Every active voxel with FA >= the seed threshold gets seedsPerVoxel seeds,
+// each jittered uniformly inside the voxel. Seed k of seed voxel v draws its
+// jitter from its own generator keyed by (randomSeed, v * seedsPerVoxel + k),
+// so every streamline is the same whatever the thread count or scheduling.
+// Streamlines never accumulate in memory: workers trace batches of seeds and
+// hand them to the writer through a bounded queue that also restores batch
+// order, so the output file is byte-identical across runs.
+class WholeBrainFiberTrack {
+private:
+    typedef std::array<double, 3> Point;
+
+    std::shared_ptr<const DirectionFAVolume> volume;
+    std::shared_ptr<const ActiveVoxelMask> activeMask;
+    StreamlineIntegrator integrator;
+    std::vector<std::array<int, 3>> seedVoxels;
+    unsigned int numThreads;
+    unsigned int seedsPerVoxel;
+    double seedMinFA;
+    uint64_t randomSeed;
+    size_t queueCapacity;
+    bool writeIndex;
+    uint64_t streamlineCount;
+    uint64_t pointCount;
+
+    void findSeedVoxels();
+    Point jitteredSeed(uint64_t seedIndex) const;
+
+public:
+    WholeBrainFiberTrack(const char* vectorBinFile, const char* faFile);
+    void setParameters(double newAlpha, double newStepSize);
+    void setStreamlineParameters(const StreamlineParameters& params);
+    void setNumberOfThreads(unsigned int newNumThreads);
+    void setSeedsPerVoxel(unsigned int count);
+    // seeds only where FA >= minFA; a negative value follows the tracking threshold
+    void setSeedFAThreshold(double minFA);
+    void setRandomSeed(uint64_t seed);
+    // batches (of 256 seeds) allowed between the slowest worker and the writer
+    void setQueueCapacity(size_t batches);
+    // also index the streamlines by voxel as they are written, saved to streamlineIndexPath(outputFile)
+    void setWriteIndex(bool enabled);
+
+    uint64_t seedCount() const;
+    // Traces every seed into a .trk or .tck file. Streamlines of a single point are dropped.
+    void traceAllFibers(const std::string& outputFile);
+    uint64_t getStreamlineCount() const { return streamlineCount; }
+    uint64_t getPointCount() const { return pointCount; }
+};
+
+#endif // WHOLE_BRAIN_FIBER_TRACK_H
\ No newline at end of file
@@ -2,6 +2,13 @@
 #include "SingleSeedFiberTrack.h"
 #include "LabeledFiberTrack.h"
 #include "FreeFiberTrack.h"
+#include "WholeBrainFiberTrack.h"
+#include "RunMetrics.h"
+#include "InMemorySubject.h"
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
 
 int main(int argc, char* argv[]) {
 
@@ -9,13 +16,100 @@ int main(int argc, char* argv[]) {
     const char* faFile = "../data/FA.nrrd";
     const char* labelFile = "../data/FALabeled.nrrd";
 
+    // --headless: trace only, no windows (batch/server runs)
+    // --progressive <fps>: redraw partial fibers while tracing, at most <fps> times per second
+    // --write-tracking-volume <file>: convert vectors + FA to a bricked tracking volume and exit
+    // --output <file.trk|file.tck>: save the labeled tractogram
+    // --cache <dir> [--cache-size <MB>]: reuse labeled fibers from earlier identical runs
+    // --whole-brain <seeds per voxel>: whole-brain tractography into the --output file, then exit
+    // --metrics <file.json|file.prom>: record per-stage timers and counters, written at the end of the run
+    // --tensor <file>: compute FA and e1 from this tensor image in memory instead of reading the files above
+    // --render-threads <n>: ray-cast threads for the FA volume rendering (default: one per core)
+    // --index: with --output, also save a voxel -> streamline index for ROI queries next to it (<output>.sidx)
+    FiberDisplayMode displayMode = FiberDisplayMode::Final;
+    double redrawRate = 1.0;
+    const char* outputFile = nullptr;
+    const char* cacheDirectory = nullptr;
+    double cacheMegabytes = 1024.0;
+    int wholeBrainSeeds = 0;
+    const char* metricsFile = nullptr;
+    const char* tensorFile = nullptr;
+    bool writeIndex = false;
+    int renderThreads = 0;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--headless") == 0) {
+            displayMode = FiberDisplayMode::Headless;
+        } else if (std::strcmp(argv[i], "--progressive") == 0 && i + 1 < argc) {
+            displayMode = FiberDisplayMode::Progressive;
+            redrawRate = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--write-tracking-volume") == 0 && i + 1 < argc) {
+            VolumeStore::writeTrackingVolume(vectorBinFile, faFile, argv[++i]);
+            return 0;
+        } else if (std::strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            outputFile = argv[++i];
+        } else if (std::strcmp(argv[i], "--cache") == 0 && i + 1 < argc) {
+            cacheDirectory = argv[++i];
+        } else if (std::strcmp(argv[i], "--cache-size") == 0 && i + 1 < argc) {
+            cacheMegabytes = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--whole-brain") == 0 && i + 1 < argc) {
+            wholeBrainSeeds = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--metrics") == 0 && i + 1 < argc) {
+            metricsFile = argv[++i];
+        } else if (std::strcmp(argv[i], "--tensor") == 0 && i + 1 < argc) {
+            tensorFile = argv[++i];
+        } else if (std::strcmp(argv[i], "--index") == 0) {
+            writeIndex = true;
+        } else if (std::strcmp(argv[i], "--render-threads") == 0 && i + 1 < argc) {
+            renderThreads = std::atoi(argv[++i]);
+        }
+    }
+    RunMetrics::enable(metricsFile != nullptr);
+    auto writeMetrics = [&]() {
+        if (metricsFile) {
+            RunMetrics::write(metricsFile);
+        }
+    };
+
+    std::unique_ptr<InMemorySubject> subject;
+    if (tensorFile) {
+        subject.reset(new InMemorySubject(tensorFile));
+        vectorBinFile = subject->vectorPath();
+        faFile = subject->faPath();
+        if (cacheDirectory) {
+            // cache keys hash the input files, which this run does not have
+            std::cerr << "--cache is ignored with --tensor" << std::endl;
+            cacheDirectory = nullptr;
+        }
+    }
+
+    if (wholeBrainSeeds > 0) {
+        if (!outputFile) {
+            std::cerr << "--whole-brain needs --output <file.trk|file.tck>" << std::endl;
+            return 1;
+        }
+        WholeBrainFiberTrack wholeBrain(vectorBinFile, faFile);
+        wholeBrain.setParameters(0.3, 1.5);
+        wholeBrain.setSeedsPerVoxel(wholeBrainSeeds);
+        wholeBrain.setWriteIndex(writeIndex);
+        wholeBrain.traceAllFibers(outputFile);
+        std::cout << "Whole brain: " << wholeBrain.getStreamlineCount() << " streamlines from "
+                  << wholeBrain.seedCount() << " seeds" << std::endl;
+        writeMetrics();
+        return 0;
+    }
+    const bool headless = displayMode == FiberDisplayMode::Headless;
+
     // 1. Volume Rendering
-    VolumeRenderer renderer("../data/FA.nrrd");
-	renderer.Render();
+    if (!headless) {
+        VolumeRenderer renderer(faFile);
+        renderer.SetRayCastThreads(renderThreads);
+        renderer.Render();
+    }
 
     // 2. Single Seed Fiber Tracking
     SingleSeedFiberTrack singleFiber(vectorBinFile, faFile);
     singleFiber.setParameters(0.3, 1.5);
+    singleFiber.setDisplayMode(displayMode, redrawRate);
     std::array<double, 3> seed = {72.0, 72.0, 34.0};
     singleFiber.traceFiber(seed);
     singleFiber.visualize();
@@ -23,19 +117,30 @@ int main(int argc, char* argv[]) {
     // 3. Labeled Fiber Tracking
     LabeledFiberTrack labeledFiber(vectorBinFile, faFile);
     labeledFiber.setParameters(0.3, 1.5);
+    labeledFiber.setDisplayMode(displayMode, redrawRate);
+    if (outputFile) {
+        labeledFiber.setOutputFile(outputFile);
+        labeledFiber.setWriteIndex(writeIndex);
+    }
+    if (cacheDirectory) {
+        labeledFiber.setCache(std::make_shared<TractogramCache>(cacheDirectory,
+                                                                static_cast<uint64_t>(cacheMegabytes * 1024 * 1024)));
+    }
     labeledFiber.traceAllFibers(labelFile);
     labeledFiber.visualize();
 
+    if (headless) {
+        writeMetrics();
+        return 0;
+    }
+
     // 4. Free Fiber Tracking
+    // further seeds come from left clicks in the window
     FreeFiberTrack freeFiber(vectorBinFile, faFile);
     freeFiber.setParameters(0.5, 0.8);
-    while (true) {
-        freeFiber.traceFiber(SeedPoint);
-        freeFiber.visualize();
-        if (!SeedPointUpdated) {
-            break;
-        }
-    }
+    freeFiber.traceFiber({72.0, 72.0, 34.0});
+    freeFiber.visualize();
 
+    writeMetrics();
     return 0;
 }
\ No newline at end of file